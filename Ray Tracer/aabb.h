@@ -0,0 +1,73 @@
+#ifndef AABB_H
+#define AABB_H
+//axis aligned bounding box, one interval per axis
+//rays that miss a box can skip everything inside it, which is what acceleration structures are built on
+#include "consts_n_utils.h"
+
+class aabb {
+public:
+	interval x, y, z;
+
+	aabb() {} //intervals default to empty, so the box does too
+
+	aabb(const interval& x, const interval& y, const interval& z) : x(x), y(y), z(z) {}
+
+	//box with corners a and b, in any order
+	aabb(const point3& a, const point3& b) {
+		x = (a[0] <= b[0]) ? interval(a[0], b[0]) : interval(b[0], a[0]);
+		y = (a[1] <= b[1]) ? interval(a[1], b[1]) : interval(b[1], a[1]);
+		z = (a[2] <= b[2]) ? interval(a[2], b[2]) : interval(b[2], a[2]);
+	}
+
+	//the box enclosing both boxes
+	aabb(const aabb& box0, const aabb& box1) : x(box0.x, box1.x), y(box0.y, box1.y), z(box0.z, box1.z) {}
+
+	const interval& axis_interval(int n) const {
+		if (n == 1) return y;
+		if (n == 2) return z;
+		return x;
+	}
+
+	point3 centroid() const {
+		return point3(0.5 * (x.min + x.max), 0.5 * (y.min + y.max), 0.5 * (z.min + z.max));
+	}
+
+	//index of the widest axis
+	int longest_axis() const {
+		if (x.size() > y.size()) {
+			return x.size() > z.size() ? 0 : 2;
+		}
+		return y.size() > z.size() ? 1 : 2;
+	}
+
+	//slab test: clip ray_t against each pair of axis planes, the ray hits if anything is left
+	//on a hit ray_t is narrowed to the part of the ray inside the box
+	bool hit(const ray& r, interval& ray_t) const {
+		const point3& ray_orig = r.origin();
+		const vec3& ray_dir = r.direction();
+
+		for (int axis = 0; axis < 3; axis++) {
+			const interval& ax = axis_interval(axis);
+			const double adinv = 1.0 / ray_dir[axis];
+
+			auto t0 = (ax.min - ray_orig[axis]) * adinv;
+			auto t1 = (ax.max - ray_orig[axis]) * adinv;
+
+			if (t0 < t1) {
+				if (t0 > ray_t.min) ray_t.min = t0;
+				if (t1 < ray_t.max) ray_t.max = t1;
+			}
+			else {
+				if (t1 > ray_t.min) ray_t.min = t1;
+				if (t0 < ray_t.max) ray_t.max = t0;
+			}
+
+			if (ray_t.max <= ray_t.min) {
+				return false;
+			}
+		}
+		return true;
+	}
+};
+
+#endif
@@ -0,0 +1,76 @@
+#ifndef ALIAS_TABLE_H
+#define ALIAS_TABLE_H
+//Walker/Vose alias table, picks index i with probability weight[i] / sum(weights) in O(1)
+//no matter how many entries there are. We use it to pick which light to sample,
+//so a scene with thousands of lights costs the same per sample as a scene with one.
+#include <vector>
+
+class alias_table {
+public:
+	alias_table() {}
+
+	alias_table(const std::vector<double>& weights) {
+		int n = int(weights.size());
+		prob.assign(n, 1.0);
+		alias.assign(n, 0);
+		pmfs.assign(n, 0.0);
+		if (n == 0) {
+			return;
+		}
+
+		double total = 0;
+		for (auto w : weights) {
+			total += (w > 0) ? w : 0;
+		}
+		//all weights zero (or negative), fall back to picking uniformly
+		for (int i = 0; i < n; i++) {
+			double w = (total > 0) ? ((weights[i] > 0) ? weights[i] : 0) / total : 1.0 / n;
+			pmfs[i] = w;
+		}
+
+		//scale so the average bucket is 1, then pair every under-full bucket with an over-full one
+		std::vector<double> scaled(n);
+		std::vector<int> small, large;
+		for (int i = 0; i < n; i++) {
+			scaled[i] = pmfs[i] * n;
+			if (scaled[i] < 1.0) small.push_back(i);
+			else large.push_back(i);
+		}
+		while (!small.empty() && !large.empty()) {
+			int s = small.back(); small.pop_back();
+			int l = large.back(); large.pop_back();
+			prob[s] = scaled[s];
+			alias[s] = l;
+			//the large bucket donated (1 - scaled[s]) of its mass to fill up s
+			scaled[l] = (scaled[l] + scaled[s]) - 1.0;
+			if (scaled[l] < 1.0) small.push_back(l);
+			else large.push_back(l);
+		}
+		//whatever is left over is 1 up to floating point error
+		for (auto i : large) prob[i] = 1.0;
+		for (auto i : small) prob[i] = 1.0;
+	}
+
+	int size() const { return int(prob.size()); }
+	bool empty() const { return prob.empty(); }
+
+	//probability of picking index i
+	double pmf(int i) const { return pmfs[i]; }
+
+	//picks an index using a single uniform number u in [0, 1)
+	int sample(double u) const {
+		int n = size();
+		double scaled = u * n;
+		int i = int(scaled);
+		if (i >= n) i = n - 1;
+		//reuse the fractional part to choose between the bucket and its alias
+		return (scaled - i < prob[i]) ? i : alias[i];
+	}
+
+private:
+	std::vector<double> prob; //chance of keeping bucket i instead of jumping to its alias
+	std::vector<int> alias; //where bucket i sends the rest of its samples
+	std::vector<double> pmfs; //normalized weights, needed when computing pdfs
+};
+
+#endif
@@ -0,0 +1,53 @@
+#ifndef AOV_BUFFERS_H
+#define AOV_BUFFERS_H
+//auxiliary output variables (AOVs): what the camera ray hit first, per pixel.
+//these are nearly noise free even at 1 spp, which is what lets the denoiser tell edges from noise
+#include "consts_n_utils.h"
+
+#include <vector>
+
+//first hit info for one camera sample
+class aov_sample {
+public:
+	color albedo = color(1, 1, 1); //surface base color, misses count as white so the background passes through demodulation unchanged
+	vec3 normal = vec3(0, 0, 0); //shading normal, zero for misses
+	double depth = 0; //distance along the camera ray, 0 for misses
+};
+
+//per pixel sums of aov_samples, row major like the color buffer. divide by the sample count to get averages
+class aov_buffers {
+public:
+	std::vector<color> albedo;
+	std::vector<vec3> normal;
+	std::vector<double> depth;
+
+	//sets every sum back to zero, for starting a new image in buffers that held an old one
+	void clear(size_t pixel_count) {
+		albedo.assign(pixel_count, color(0, 0, 0));
+		normal.assign(pixel_count, vec3(0, 0, 0));
+		depth.assign(pixel_count, 0.0);
+	}
+
+	//keeps the sums, for adding more samples to the same image
+	void resize(size_t pixel_count) {
+		albedo.resize(pixel_count);
+		normal.resize(pixel_count);
+		depth.resize(pixel_count);
+	}
+
+	void add(size_t index, const aov_sample& sample) {
+		albedo[index] += sample.albedo;
+		normal[index] += sample.normal;
+		depth[index] += sample.depth;
+	}
+
+	void scale(double s) {
+		for (size_t k = 0; k < albedo.size(); k++) {
+			albedo[k] *= s;
+			normal[k] *= s;
+			depth[k] *= s;
+		}
+	}
+};
+
+#endif
@@ -0,0 +1,745 @@
+#ifndef BENCHMARKS_H
+#define BENCHMARKS_H
+//small benchmark scenes and reports, run from main with a --bench-... argument
+//results go to cout as plain text so they don't get mixed up with the ppm output of a normal render
+#include "consts_n_utils.h"
+
+#include "camera.h"
+#include "denoiser.h"
+#include "shared_framebuffer.h"
+#include "environment_light.h"
+#include "hittable_list.h"
+#include "light_list.h"
+#include "material.h"
+#include "out_of_core_scene.h"
+#include "render_server.h"
+#include "scene_file.h"
+#include "scenes.h"
+#include "sphere.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+extern char** environ; //for posix_spawn, not every unistd.h declares it
+#endif
+
+//root mean square error between two accumulated images, each scaled by 1 / its sample count
+//values are clamped to [0, 1] first like write_color does, otherwise the few pixels that see a light directly swamp everything else
+inline double image_rmse(const std::vector<color>& image, double scale, const std::vector<color>& reference, double reference_scale) {
+	static const interval displayable(0, 1);
+	double sum = 0;
+	for (size_t k = 0; k < image.size(); k++) {
+		for (int c = 0; c < 3; c++) {
+			auto diff = displayable.clamp(scale * image[k][c]) - displayable.clamp(reference_scale * reference[k][c]);
+			sum += diff * diff / 3;
+		}
+	}
+	return std::sqrt(sum / image.size());
+}
+
+//seconds since start
+inline double seconds_since(std::chrono::steady_clock::time_point start) {
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+//equal time RMSE of plain path tracing against next event estimation + MIS on one scene
+inline void compare_nee(const char* scene_name, const hittable& world, const light_list& lights, camera& cam, double seconds_per_run, int reference_passes) {
+	std::clog << "Rendering reference (" << reference_passes << " spp with NEE)...\n";
+	std::vector<color> reference;
+	for (int pass = 0; pass < reference_passes; pass++) {
+		cam.render_pass(world, lights, reference);
+	}
+
+	//no lights in the list turns light sampling off, paths only see the light if they bounce into it
+	light_list no_lights;
+	const light_list* modes[2] = { &no_lights, &lights };
+	const char* names[2] = { "path tracing", "NEE + MIS" };
+
+	std::cout << "equal time RMSE, " << seconds_per_run << "s per run, " << scene_name << "\n";
+	for (int m = 0; m < 2; m++) {
+		std::vector<color> image;
+		int passes = 0;
+		auto start = std::chrono::steady_clock::now();
+		while (seconds_since(start) < seconds_per_run) {
+			cam.render_pass(world, *modes[m], image);
+			passes++;
+		}
+		auto elapsed = seconds_since(start);
+		std::cout << names[m] << ": " << passes << " spp in " << elapsed << "s, RMSE "
+			<< image_rmse(image, 1.0 / passes, reference, 1.0 / reference_passes) << '\n';
+	}
+}
+
+//next event estimation against plain path tracing with one small light and with many,
+//plus how long building the light list takes for thousands of lights
+inline int bench_nee(double seconds_per_run = 1.0, int reference_passes = 2048) {
+	{
+		hittable_list world;
+		light_list lights;
+		camera cam;
+		small_light_scene(world, lights, cam);
+		compare_nee("small light scene", world, lights, cam, seconds_per_run, reference_passes);
+	}
+	{
+		//every light is in the world list too, so keep the count low enough that hit() stays cheap
+		hittable_list world;
+		light_list lights;
+		camera cam;
+		many_lights_scene(world, lights, cam, 64);
+		cam.image_width = 80;
+		compare_nee("64 lights scene", world, lights, cam, seconds_per_run, reference_passes / 4);
+	}
+
+	int counts[3] = { 1000, 10000, 30000 };
+	for (int count : counts) {
+		hittable_list world;
+		light_list lights;
+		camera cam;
+		auto start = std::chrono::steady_clock::now();
+		many_lights_scene(world, lights, cam, count);
+		lights.finalize();
+		std::cout << count << " lights: scene and light list built in " << seconds_since(start) << "s\n";
+	}
+	return 0;
+}
+
+//mean and standard error of the per pass image means
+inline void pass_mean(const std::vector<double>& means, double& mean, double& error) {
+	mean = 0;
+	for (double m : means) mean += m;
+	mean /= means.size();
+	double variance = 0;
+	for (double m : means) variance += (m - mean) * (m - mean);
+	variance /= means.size() - 1;
+	error = std::sqrt(variance / means.size());
+}
+
+/*regression check that light sampling stays unbiased on rough metal: path tracing and NEE + MIS have to agree
+on the mean of a GGX sphere lit by a sphere light, within 4 standard errors. rough GGX fails its bsdf sample often
+(it reflects below the horizon), and skipping the light sample on those paths once made NEE come out 6% (roughness 0.5)
+to 24% (roughness 0.8) dark. also run through trace_wavefront by handing the camera a world that says it's batched.
+returns 1 if any case disagrees*/
+inline int check_rough_metal_nee(int passes = 2000) {
+	//the same world, but renders take the wavefront path for it
+	class batched_world : public hittable {
+	public:
+		batched_world(const hittable& inner) : inner(inner) {}
+		bool hit(const ray& r, interval ray_t, hit_record& rec) const override { return inner.hit(r, ray_t, rec); }
+		unsigned material_kinds() const override { return inner.material_kinds(); }
+		bool batched() const override { return true; }
+	private:
+		const hittable& inner;
+	};
+
+	int failures = 0;
+	double roughnesses[2] = { 0.5, 0.8 };
+	for (double roughness : roughnesses) {
+		hittable_list world;
+		light_list lights;
+		world.add(make_shared<sphere>(point3(0, 0, 0), 1, make_shared<metal>(color(0.9, 0.8, 0.7), roughness)));
+		auto light = make_shared<sphere>(point3(0, 3, 1.5), 1, make_shared<diffuse_light>(color(4, 4, 4)));
+		world.add(light);
+		lights.add(light);
+		batched_world wavefront_world(world);
+
+		camera cam;
+		cam.image_width = 32;
+		cam.max_depth = 3;
+		cam.vfov = 30;
+		cam.lookfrom = point3(0, 1, 5);
+		cam.lookat = point3(0, 0, 0);
+		cam.sky_gradient = false;
+		cam.background = color(0, 0, 0);
+
+		light_list no_lights;
+		const hittable* worlds[3] = { &world, &world, &wavefront_world };
+		const light_list* modes[3] = { &no_lights, &lights, &lights };
+		const char* names[3] = { "path tracing", "NEE + MIS", "NEE + MIS, wavefront" };
+		double mean[3], error[3];
+		for (int m = 0; m < 3; m++) {
+			std::vector<double> means;
+			for (int pass = 0; pass < passes; pass++) {
+				std::vector<color> image;
+				cam.render_pass(*worlds[m], *modes[m], image);
+				double sum = 0;
+				for (const auto& pixel : image) {
+					sum += (pixel.x() + pixel.y() + pixel.z()) / 3;
+				}
+				means.push_back(sum / image.size());
+			}
+			pass_mean(means, mean[m], error[m]);
+			std::cout << "roughness " << roughness << ", " << names[m] << ": " << mean[m] << " +- " << error[m];
+			if (m > 0) {
+				bool agrees = std::fabs(mean[m] - mean[0]) <= 4 * std::sqrt(error[m] * error[m] + error[0] * error[0]);
+				std::cout << (agrees ? " ok" : " MISMATCH");
+				failures += !agrees;
+			}
+			std::cout << "\n";
+		}
+	}
+	return failures > 0 ? 1 : 0;
+}
+
+//a dim blue sky with a small, very bright sun, the worst case for uniformly sampling an environment
+inline hdr_image synthetic_sky(int width, int height) {
+	std::vector<float> data(size_t(width) * height * 3);
+	vec3 sun_direction = unit_vector(vec3(-1, 1.2, 0.6));
+	auto sun_cos = std::cos(degrees_to_radians(2.0));
+	for (int y = 0; y < height; y++) {
+		auto theta = pi * (y + 0.5) / height;
+		for (int x = 0; x < width; x++) {
+			auto phi = 2 * pi * (x + 0.5) / width;
+			vec3 d(-std::sin(theta) * std::cos(phi), std::cos(theta), std::sin(theta) * std::sin(phi));
+			auto a = 0.5 * (d.y() + 1.0);
+			color c = (1.0 - a) * color(0.3, 0.3, 0.3) + a * color(0.2, 0.35, 0.7);
+			if (dot(d, sun_direction) > sun_cos) {
+				c = color(5000, 4500, 4000);
+			}
+			for (int k = 0; k < 3; k++) {
+				data[(size_t(y) * width + x) * 3 + k] = float(c[k]);
+			}
+		}
+	}
+	return hdr_image(width, height, data);
+}
+
+//load time, memory and equal time RMSE of importance sampled vs uniformly sampled environment lighting
+//uses the given .hdr/.pfm map, or writes out a synthetic sun and sky if there isn't one
+inline int bench_env(std::string filename = "", double seconds_per_run = 1.0, int reference_passes = 1024) {
+	if (filename.empty()) {
+		filename = "bench_sky.pfm";
+		if (!synthetic_sky(2048, 1024).save_pfm(filename)) {
+			return 1;
+		}
+	}
+
+	auto env = make_shared<environment_light>();
+	auto start = std::chrono::steady_clock::now();
+	if (!env->load(filename)) {
+		return 1;
+	}
+	auto load_seconds = seconds_since(start);
+	std::cout << "environment '" << filename << "': loaded in " << load_seconds << "s, "
+		<< env->memory_bytes() / (1024.0 * 1024.0) << " MiB with sampling tables\n";
+
+	hittable_list world;
+	camera cam;
+	three_spheres_scene(world, cam);
+	cam.environment = env;
+	light_list lights;
+
+	std::clog << "Rendering reference (" << reference_passes << " spp, importance sampled)...\n";
+	std::vector<color> reference;
+	for (int pass = 0; pass < reference_passes; pass++) {
+		cam.render_pass(world, lights, reference);
+	}
+
+	const char* names[2] = { "uniform sampling", "importance sampling" };
+	std::cout << "equal time RMSE, " << seconds_per_run << "s per run\n";
+	for (int m = 0; m < 2; m++) {
+		env->importance_sampling = (m == 1);
+		std::vector<color> image;
+		int passes = 0;
+		start = std::chrono::steady_clock::now();
+		while (seconds_since(start) < seconds_per_run) {
+			cam.render_pass(world, lights, image);
+			passes++;
+		}
+		auto elapsed = seconds_since(start);
+		std::cout << names[m] << ": " << passes << " spp in " << elapsed << "s, RMSE "
+			<< image_rmse(image, 1.0 / passes, reference, 1.0 / reference_passes) << '\n';
+	}
+	return 0;
+}
+
+//how many spp it takes to reach target_rmse with and without the denoiser on the three spheres under the sky
+//renders progressively and checks the error at every power of two spp
+inline int bench_denoise(double target_rmse = 0.01, int max_spp = 256, int reference_passes = 4096) {
+	hittable_list world;
+	light_list lights;
+	camera cam;
+	three_spheres_scene(world, cam);
+
+	std::clog << "Rendering reference (" << reference_passes << " spp)...\n";
+	std::vector<color> reference;
+	for (int pass = 0; pass < reference_passes; pass++) {
+		cam.render_pass(world, lights, reference);
+	}
+
+	std::cout << "spp, render s, RMSE, denoised RMSE, denoise ms\n";
+	std::vector<color> image;
+	aov_buffers aovs;
+	denoiser filter;
+	int raw_spp = 0, denoised_spp = 0;
+	double raw_seconds = 0, denoised_seconds = 0;
+	double render_seconds = 0;
+	for (int spp = 1; spp <= max_spp; spp++) {
+		auto start = std::chrono::steady_clock::now();
+		cam.render_pass(world, lights, image, &aovs);
+		render_seconds += seconds_since(start);
+		if ((spp & (spp - 1)) != 0) {
+			continue;
+		}
+
+		//filter a copy so the accumulation can keep going
+		std::vector<color> averaged(image.size());
+		for (size_t k = 0; k < image.size(); k++) {
+			averaged[k] = image[k] / spp;
+		}
+		aov_buffers averaged_aovs = aovs;
+		averaged_aovs.scale(1.0 / spp);
+		auto raw_rmse = image_rmse(averaged, 1.0, reference, 1.0 / reference_passes);
+		start = std::chrono::steady_clock::now();
+		filter.run(averaged, averaged_aovs, cam.image_width, int(image.size() / cam.image_width));
+		auto denoise_seconds = seconds_since(start);
+		auto denoised_rmse = image_rmse(averaged, 1.0, reference, 1.0 / reference_passes);
+
+		std::cout << spp << ", " << render_seconds << ", " << raw_rmse << ", " << denoised_rmse << ", " << 1000 * denoise_seconds << '\n';
+		if (raw_spp == 0 && raw_rmse <= target_rmse) {
+			raw_spp = spp;
+			raw_seconds = render_seconds;
+		}
+		if (denoised_spp == 0 && denoised_rmse <= target_rmse) {
+			denoised_spp = spp;
+			denoised_seconds = render_seconds + denoise_seconds;
+		}
+	}
+
+	std::cout << "target RMSE " << target_rmse << ":\n";
+	std::cout << "without denoiser: ";
+	if (raw_spp) std::cout << raw_spp << " spp, " << raw_seconds << "s\n";
+	else std::cout << "not reached by " << max_spp << " spp\n";
+	std::cout << "with denoiser: ";
+	if (denoised_spp) std::cout << denoised_spp << " spp, " << denoised_seconds << "s\n";
+	else std::cout << "not reached by " << max_spp << " spp\n";
+	return 0;
+}
+
+//reads the latest published pass of a running progressive render and writes it to cout as a ppm
+inline int dump_preview(const std::string& name) {
+	shared_framebuffer preview;
+	if (!preview.open(name)) {
+		return 1;
+	}
+	std::vector<color> pixels;
+	int samples;
+	if (!preview.read(pixels, samples)) {
+		std::cerr << "ERROR: '" << name << "' has no finished pass yet\n";
+		return 1;
+	}
+	std::clog << name << ": " << preview.width() << "x" << preview.height() << ", " << samples << " spp\n";
+	write_ppm(std::cout, pixels, preview.width(), preview.height());
+	return 0;
+}
+
+//time to first image and the cost of publishing every pass to shared memory.
+//compares the same progressive render with and without the preview, plus a plain render for reference
+inline int bench_preview(int passes = 32, int runs = 5) {
+	hittable_list world;
+	camera cam;
+	three_spheres_scene(world, cam);
+	cam.image_width = 640;
+	cam.samples_per_pixel = passes;
+	light_list lights;
+	std::vector<color> image;
+	aov_buffers aovs;
+
+	//a viewer refreshing at 60Hz, like a window showing the preview would
+	std::atomic<bool> rendering(false);
+	std::atomic<int> reads(0);
+	auto viewer = [&]() {
+		shared_framebuffer reader;
+		std::vector<color> pixels;
+		int samples;
+		while (rendering) {
+			if (reader.is_open() || reader.open("rt_bench_preview")) {
+				if (reader.read(pixels, samples)) {
+					reads++;
+				}
+			}
+			std::this_thread::sleep_for(std::chrono::milliseconds(16));
+		}
+	};
+
+	const char* names[3] = { "without preview", "publishing, no viewer", "publishing, 60Hz viewer" };
+	std::cout << "progressive " << cam.image_width << " wide, " << passes << " passes, best of " << runs << "\n";
+	for (int m = 0; m < 3; m++) {
+		cam.preview_name = (m > 0) ? "rt_bench_preview" : "";
+		progressive_stats best;
+		best.total_seconds = infinity;
+		for (int run = 0; run < runs; run++) {
+			rendering = true;
+			std::thread viewer_thread;
+			if (m == 2) {
+				viewer_thread = std::thread(viewer);
+			}
+			auto stats = cam.render_progressive(world, lights, image, aovs);
+			rendering = false;
+			if (viewer_thread.joinable()) {
+				viewer_thread.join();
+			}
+			if (stats.total_seconds < best.total_seconds) {
+				best = stats;
+			}
+		}
+		std::cout << names[m] << ": first image " << 1000 * best.first_image_seconds
+			<< " ms, total " << best.total_seconds << "s\n";
+	}
+	std::clog << "\n";
+	std::cout << "viewer reads: " << reads << "\n";
+
+	//the old way, the image only exists once every sample of every pixel is done
+	cam.preview_name = "";
+	auto start = std::chrono::steady_clock::now();
+	std::vector<color> plain;
+	for (int pass = 0; pass < passes; pass++) {
+		cam.render_pass(world, lights, plain);
+	}
+	std::cout << "single threaded render, first (and only) image: " << seconds_since(start) << "s\n";
+	return 0;
+}
+
+//samples per second of each per-sample kernel specialization on its own, and all of them together, against the generic kernel.
+//RMSE is against the generic image, it should stay at the noise level since the math is the same
+inline int bench_kernels(int passes = 8, int runs = 9) {
+	struct bench_scene {
+		const char* name;
+		hittable_list world;
+		light_list lights;
+		camera cam;
+	};
+	std::vector<bench_scene> scenes(3);
+	scenes[0].name = "three spheres under the sky";
+	three_spheres_scene(scenes[0].world, scenes[0].cam);
+	scenes[1].name = "three spheres, small light";
+	small_light_scene(scenes[1].world, scenes[1].lights, scenes[1].cam);
+	//the final render's settings: glass, depth of field and 50 bounces
+	scenes[2].name = "three spheres + glass, defocus, depth 50";
+	three_spheres_scene(scenes[2].world, scenes[2].cam);
+	scenes[2].world.add(make_shared<sphere>(point3(0, 0.5, 2.5), 0.5, make_shared<dielectric>(1.5)));
+	scenes[2].cam.max_depth = 50;
+	scenes[2].cam.defocus_angle = 0.6;
+	scenes[2].cam.focus_dist = 12;
+
+	const unsigned modes[4] = { 0, camera::specialize_defocus, camera::specialize_materials, camera::specialize_all };
+	const char* names[4] = { "generic", "defocus", "materials", "all" };
+	std::cout << passes << " spp, single thread, best of " << runs << "\n";
+	for (auto& scene : scenes) {
+		std::cout << scene.name << "\n";
+		//the modes take turns within each run, so a slow patch on the machine doesn't land on just one of them
+		std::vector<std::vector<color>> images(4);
+		std::vector<double> best(4, infinity);
+		std::vector<std::string> kernels(4);
+		for (int run = 0; run < runs; run++) {
+			for (int m = 0; m < 4; m++) {
+				scene.cam.specialize = modes[m];
+				images[m].clear();
+				auto start = std::chrono::steady_clock::now();
+				for (int pass = 0; pass < passes; pass++) {
+					scene.cam.render_pass(scene.world, scene.lights, images[m]);
+				}
+				best[m] = std::fmin(best[m], seconds_since(start));
+				kernels[m] = scene.cam.kernel_name();
+			}
+		}
+		for (int m = 0; m < 4; m++) {
+			auto samples = double(images[m].size()) * passes;
+			std::cout << "  " << names[m] << " (" << kernels[m] << "): " << samples / best[m] / 1e6
+				<< " Msamples/s, " << best[0] / best[m] << "x, RMSE vs generic "
+				<< image_rmse(images[m], 1.0 / passes, images[0], 1.0 / passes) << "\n";
+		}
+	}
+	return 0;
+}
+
+//physical memory of the machine in bytes, so the out of core report can say how the scene compares
+inline double physical_memory_bytes() {
+#ifdef _WIN32
+	MEMORYSTATUSEX status;
+	status.dwLength = sizeof(status);
+	GlobalMemoryStatusEx(&status);
+	return double(status.ullTotalPhys);
+#else
+	return double(sysconf(_SC_PHYS_PAGES)) * double(sysconf(_SC_PAGESIZE));
+#endif
+}
+
+//writes a field of small spheres laid out on a square grid of cells, one chunk per cell.
+//each chunk is generated and written on its own, so the scene never has to fit in memory while it's made
+inline bool write_sphere_field(const std::string& path, std::uint64_t sphere_count, std::uint32_t spheres_per_chunk, double& field_size) {
+	std::vector<scene_material> materials;
+	for (int m = 0; m < 8; m++) {
+		scene_material desc;
+		desc.type = (m < 6) ? scene_material::lambertian_kind : scene_material::metal_kind;
+		color c = color::random(0.2, 0.9);
+		for (int a = 0; a < 3; a++) desc.albedo[a] = float(c[a]);
+		desc.param = (m < 6) ? 0.0f : 0.3f;
+		materials.push_back(desc);
+	}
+	scene_file_writer writer;
+	if (!writer.open(path, materials)) {
+		return false;
+	}
+	auto chunk_total = (sphere_count + spheres_per_chunk - 1) / spheres_per_chunk;
+	auto cells = std::uint64_t(std::ceil(std::sqrt(double(chunk_total))));
+	//cells are sized so the spheres in them are about as dense as in the book's final scene
+	double cell = std::sqrt(double(spheres_per_chunk)) * 1.2;
+	field_size = cells * cell;
+	std::vector<packed_sphere> spheres;
+	for (std::uint64_t c = 0; c < chunk_total; c++) {
+		double x0 = (c % cells) * cell;
+		double z0 = (c / cells) * cell;
+		auto count = std::min<std::uint64_t>(spheres_per_chunk, sphere_count - c * spheres_per_chunk);
+		spheres.resize(size_t(count));
+		for (auto& s : spheres) {
+			s.radius = float(random_double(0.1, 0.4));
+			s.center[0] = float(x0 + random_double(0, cell));
+			s.center[1] = s.radius;
+			s.center[2] = float(z0 + random_double(0, cell));
+			s.material = std::uint32_t(random_double(0, 8)) % 8;
+		}
+		if (!writer.add_chunk(spheres)) {
+			return false;
+		}
+		if (c % 64 == 0) {
+			std::clog << "\rWriting chunks: " << c << '/' << chunk_total << ' ' << std::flush;
+		}
+	}
+	std::clog << "\r                                   \r";
+	return writer.close();
+}
+
+//rays/s of one ray at a time vs batched traversal of a scene file, with the chunk cache at several sizes.
+//the scene is written to path first; make millions big enough and it won't fit in RAM, then the OS has to page it too
+inline int bench_out_of_core(double millions = 2, std::string path = "", int ray_count = 200000) {
+	if (path.empty()) {
+		path = "bench_scene.bin";
+	}
+	auto sphere_count = std::uint64_t(millions * 1e6);
+	double field_size;
+	auto start = std::chrono::steady_clock::now();
+	if (!write_sphere_field(path, sphere_count, 8192, field_size)) {
+		return 1;
+	}
+	auto write_seconds = seconds_since(start);
+
+	out_of_core_scene scene;
+	if (!scene.open(path)) {
+		return 1;
+	}
+	const double mib = 1024.0 * 1024.0;
+	std::cout << sphere_count << " spheres in " << scene.chunk_count() << " chunks, file " << scene.file_size() / mib
+		<< " MiB (written in " << write_seconds << "s), physical memory " << physical_memory_bytes() / mib << " MiB\n";
+
+	//rays from a camera hovering over the field looking down at a random spot, in random order
+	std::vector<ray> rays;
+	for (int i = 0; i < ray_count; i++) {
+		point3 origin(random_double(0, field_size), 20, random_double(0, field_size));
+		point3 target(random_double(0, field_size), 0, random_double(0, field_size));
+		rays.push_back(ray(origin, target - origin));
+	}
+
+	const int batch_size = 65536;
+	std::vector<hit_record> recs;
+	std::vector<char> hits;
+	double budgets[3] = { 1.0 / 16, 1.0 / 4, 1.0 };
+	std::cout << ray_count << " incoherent rays, batches of " << batch_size << "\n";
+	for (double fraction : budgets) {
+		scene.set_memory_budget(size_t(fraction * scene.file_size()));
+
+		scene.clear_cache();
+		auto loads = scene.chunk_loads();
+		int sync_hits = 0;
+		start = std::chrono::steady_clock::now();
+		for (const auto& r : rays) {
+			hit_record rec;
+			sync_hits += scene.hit(r, interval(0.001, infinity), rec);
+		}
+		auto sync_seconds = seconds_since(start);
+		auto sync_loads = scene.chunk_loads() - loads;
+
+		scene.clear_cache();
+		loads = scene.chunk_loads();
+		int batch_hits = 0;
+		start = std::chrono::steady_clock::now();
+		std::vector<ray> batch;
+		for (size_t first = 0; first < rays.size(); first += batch_size) {
+			batch.assign(rays.begin() + first, rays.begin() + std::min(rays.size(), first + batch_size));
+			scene.hit_batch(batch, interval(0.001, infinity), recs, hits);
+			for (char h : hits) batch_hits += h;
+		}
+		auto batch_seconds = seconds_since(start);
+		auto batch_loads = scene.chunk_loads() - loads;
+
+		std::cout << "budget " << fraction * scene.file_size() / mib << " MiB: one at a time " << ray_count / sync_seconds
+			<< " rays/s (" << sync_loads << " chunk loads), batched " << ray_count / batch_seconds
+			<< " rays/s (" << batch_loads << " chunk loads)";
+		if (sync_hits != batch_hits) {
+			std::cout << " MISMATCH " << sync_hits << " vs " << batch_hits;
+		}
+		std::cout << "\n";
+	}
+
+	//the same through the renderer: one pass over a wide view of the field at the smallest budget,
+	//a path at a time vs in wavefronts through hit_batch
+	camera cam;
+	cam.aspect_ratio = 16.0 / 9.0;
+	cam.image_width = 320;
+	cam.max_depth = 8;
+	cam.lookfrom = point3(field_size / 2, field_size / 4, -field_size / 8);
+	cam.lookat = point3(field_size / 2, 0, field_size / 2);
+	cam.vfov = 60;
+	scene.set_memory_budget(size_t(budgets[0] * scene.file_size()));
+	std::vector<color> images[2];
+	double pass_seconds[2];
+	for (int m = 0; m < 2; m++) {
+		cam.ray_batch = (m == 0) ? 0 : camera().ray_batch;
+		scene.clear_cache();
+		auto loads = scene.chunk_loads();
+		start = std::chrono::steady_clock::now();
+		cam.render_pass(scene, light_list(), images[m]);
+		pass_seconds[m] = seconds_since(start);
+		std::cout << "render pass, " << (m == 0 ? "one path at a time: " : "wavefronts: ") << pass_seconds[m] << "s ("
+			<< scene.chunk_loads() - loads << " chunk loads, " << cam.kernel_name() << ")\n";
+	}
+	std::cout << "wavefront speedup " << pass_seconds[0] / pass_seconds[1] << "x, 1 spp RMSE between them "
+		<< image_rmse(images[1], 1.0, images[0], 1.0) << "\n";
+	scene.close();
+	std::remove(path.c_str());
+	return 0;
+}
+
+//latency of each job in a mix, reported per kind of job
+inline void report_latencies(const char* name, const std::vector<std::string>& jobs, const std::vector<double>& latency, double makespan) {
+	double thumb_sum = 0, thumb_max = 0, frame_sum = 0, frame_max = 0;
+	int thumbs = 0, frames = 0;
+	for (size_t k = 0; k < jobs.size(); k++) {
+		//frames have priority 1, thumbnails more
+		if (jobs[k].find("priority=1") != std::string::npos) {
+			frame_sum += latency[k];
+			frame_max = std::fmax(frame_max, latency[k]);
+			frames++;
+		}
+		else {
+			thumb_sum += latency[k];
+			thumb_max = std::fmax(thumb_max, latency[k]);
+			thumbs++;
+		}
+	}
+	std::cout << name << ": all done in " << makespan << "s (" << jobs.size() / makespan << " jobs/s), thumbnails mean "
+		<< thumb_sum / thumbs << "s max " << thumb_max << "s, frames mean " << frame_sum / frames << "s max " << frame_max << "s\n";
+}
+
+//a mix of big frames and thumbnails all submitted at once: to one render server over its socket (twice, so the
+//second round finds every scene cached), and as one process per job like separate runs of main.
+//self is the path of this executable, to start the per job processes with
+inline int bench_server(const std::string& self) {
+#ifdef _WIN32
+	std::cerr << "ERROR: the render server needs Unix domain sockets, it isn't available in Windows builds\n";
+	return 1;
+#else
+	double field_size;
+	std::string field = "bench_scene.bin";
+	if (!write_sphere_field(field, 500000, 8192, field_size)) {
+		return 1;
+	}
+	std::vector<std::string> jobs = {
+		"scene=book width=320 spp=8 depth=8 priority=1",
+		"scene=" + field + " width=320 spp=8 depth=8 priority=1",
+	};
+	const char* thumb_scenes[3] = { "book", "three_spheres", "bench_scene.bin" };
+	for (int t = 0; t < 12; t++) {
+		jobs.push_back(std::string("scene=") + thumb_scenes[t % 3] + " width=64 spp=2 depth=8 priority=8");
+	}
+	std::cout << jobs.size() << " jobs (2 frames 320 wide at 8 spp, 12 thumbnails 64 wide at 2 spp), " << std::thread::hardware_concurrency() << " hardware threads\n";
+
+	//one server, every job on its own client connection at the same time
+	std::string socket_path = "/tmp/rt_bench_server_" + std::to_string(getpid()) + ".sock";
+	render_server server;
+	if (!server.listen(socket_path)) {
+		return 1;
+	}
+	std::thread server_thread([&]() { server.serve(); });
+	for (int round = 0; round < 2; round++) {
+		std::vector<double> latency(jobs.size());
+		std::vector<std::thread> clients;
+		auto start = std::chrono::steady_clock::now();
+		for (size_t k = 0; k < jobs.size(); k++) {
+			clients.emplace_back([&, k]() {
+				std::string reply;
+				if (!send_request(socket_path, jobs[k], reply) || reply.compare(0, 2, "ok") != 0) {
+					std::cerr << "ERROR: job '" << jobs[k] << "' failed: " << reply << "\n";
+				}
+				latency[k] = seconds_since(start);
+			});
+		}
+		for (auto& client : clients) {
+			client.join();
+		}
+		report_latencies(round == 0 ? "server, cold scene cache" : "server, warm scene cache", jobs, latency, seconds_since(start));
+	}
+	std::string reply;
+	send_request(socket_path, "shutdown", reply);
+	server_thread.join();
+
+	//one process per job, all started together and left to fight over the cores
+	std::vector<double> latency(jobs.size());
+	std::vector<pid_t> pids(jobs.size());
+	posix_spawn_file_actions_t quiet;
+	posix_spawn_file_actions_init(&quiet);
+	posix_spawn_file_actions_addopen(&quiet, 1, "/dev/null", O_WRONLY, 0);
+	posix_spawn_file_actions_addopen(&quiet, 2, "/dev/null", O_WRONLY, 0);
+	//argv[0] is just the name when we were started through PATH, so prefer the real path of this executable,
+	//and failing that let posix_spawnp look argv[0] up the same way the shell did
+	std::string program = self;
+	char exe_path[4096];
+	auto exe_length = readlink("/proc/self/exe", exe_path, sizeof(exe_path));
+	if (exe_length > 0 && size_t(exe_length) < sizeof(exe_path)) {
+		program.assign(exe_path, size_t(exe_length));
+	}
+	auto start = std::chrono::steady_clock::now();
+	for (size_t k = 0; k < jobs.size(); k++) {
+		std::string job_flag = "--job";
+		std::vector<char*> args = { const_cast<char*>(self.c_str()), &job_flag[0], &jobs[k][0], nullptr };
+		if (posix_spawnp(&pids[k], program.c_str(), &quiet, nullptr, args.data(), environ) != 0) {
+			std::cerr << "ERROR: could not start '" << program << "'\n";
+			return 1;
+		}
+	}
+	for (size_t done = 0; done < jobs.size(); done++) {
+		int status;
+		pid_t pid = waitpid(-1, &status, 0);
+		for (size_t k = 0; k < jobs.size(); k++) {
+			if (pids[k] == pid) {
+				latency[k] = seconds_since(start);
+				if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+					std::cerr << "ERROR: job '" << jobs[k] << "' failed\n";
+				}
+			}
+		}
+	}
+	posix_spawn_file_actions_destroy(&quiet);
+	report_latencies("one process per job", jobs, latency, seconds_since(start));
+	std::remove(field.c_str());
+	return 0;
+#endif
+}
+
+#endif
@@ -3,6 +3,28 @@
 
 #include "hittable.h"
 #include "material.h"
+#include "light_list.h"
+#include "environment_light.h"
+#include "aov_buffers.h"
+#include "denoiser.h"
+#include "shared_framebuffer.h"
+#include "worker_group.h"
+
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <string>
+#include <thread>
+
+#include <vector>
+
+//timings from a progressive render
+class progressive_stats {
+public:
+	int passes = 0;
+	double first_image_seconds = 0; //until the first full pass was done (and published, if previewing)
+	double total_seconds = 0;
+};
 
 class camera {
 public:
@@ -22,10 +44,33 @@ public:
 	double defocus_angle = 0; //variation angle of rays through each pixel
 	double focus_dist = 10; // distance from camera lookfrom point to "plane of perfect focus"
 
+	bool sky_gradient = true; //on a miss draw the white to blue sky, otherwise use background
+	color background = color(0, 0, 0); //flat background color, for scenes lit only by their own lights
+	shared_ptr<environment_light> environment; //HDR map around the scene, replaces the sky and background when set
+
+	bool denoise = false; //run the a-trous denoiser (guided by the first hit albedo, normal and depth) before writing the image
+	std::string aov_prefix; //if set, also write <prefix>_albedo.ppm, <prefix>_normal.ppm and <prefix>_depth.ppm
+
+	bool progressive = false; //render samples_per_pixel full image passes of 1 spp each, spread across threads
+	std::string preview_name; //if set, render progressively and publish every pass to this shared framebuffer (see --dump-preview)
+	int render_threads = 0; //threads for progressive renders, 0 means one per hardware thread
+
+	//which parts of the per-sample path get compiled specially for the scene at render start (see choose_kernel)
+	//0 keeps everything generic: runtime defocus checks, virtual material calls
+	unsigned specialize = specialize_all;
+	enum specialization : unsigned {
+		specialize_defocus = 1, //camera rays skip the defocus check, and the disk sample when it's off
+		specialize_materials = 2, //materials are called through their concrete class, lights skipped if there are none
+		specialize_all = 3
+	};
+	//rays traced together, a bounce at a time, when the world is batched() (out of core scenes), so each chunk is read once per
+	//wavefront instead of once per ray. 0 always traces one path at a time
+	int ray_batch = 16384;
 
 	//renders an ppm image in P3 format.
-	void render(const hittable& world) {
-		initialize();
+	//lights are the emitters we aim shadow rays at, they should also be in world.
+	void render(const hittable& world, const light_list& lights = light_list()) {
+		initialize(world);
 
 		//Render
 
@@ -49,24 +94,194 @@ public:
 
 		*/
 
-		std::cout << "P3\n" << image_width << ' ' << image_height << "\n255\n";
+		//progressive passes, denoising and AOV output need the whole image, otherwise we can stream pixels out as we go
+		//wavefronts are traced a pass at a time, so they go through the progressive renderer too
+		bool progressive_mode = progressive || !preview_name.empty() || use_wavefront;
+		bool keep_image = progressive_mode || denoise || !aov_prefix.empty();
+		size_t pixel_count = size_t(image_width) * image_height;
+		std::vector<color> image;
+		aov_buffers aovs;
+		if (keep_image) {
+			image.resize(pixel_count);
+			aovs.clear(pixel_count);
+		}
+		else {
+			std::cout << "P3\n" << image_width << ' ' << image_height << "\n255\n";
+		}
+		if (progressive_mode) {
+			render_progressive(world, lights, image, aovs);
+		}
 		//currently pixels rendered in rows left to right, top to bottom
-		for (int j = 0; j < image_height; j++) {
+		for (int j = 0; j < image_height && !progressive_mode; j++) {
 			//Progress bar for particularly long renders
 			std::clog << "\rScanlines remaining: " << (image_height - j) << ' ' << std::flush;
 			for (int i = 0; i < image_width; i++) {
+				if (keep_image) {
+					size_t index = size_t(j) * image_width + i;
+					for (int sample = 0; sample < samples_per_pixel; sample++) {
+						add_sample(i, j, world, lights, image[index], &aovs, index);
+					}
+					image[index] *= pixel_samples_scale;
+					continue;
+				}
 				color pixel_color(0, 0, 0);
 				for (int sample = 0; sample < samples_per_pixel; sample++) {
-					ray r = get_ray(i, j);
-					pixel_color += ray_color(r, max_depth, world);
+					add_sample(i, j, world, lights, pixel_color, nullptr, 0);
 				}
 				write_color(std::cout, pixel_samples_scale * pixel_color);
 
 			}
 		}
+		if (keep_image) {
+			aovs.scale(pixel_samples_scale);
+			if (denoise) {
+				std::clog << "\rDenoising...          " << std::flush;
+				denoiser().run(image, aovs, image_width, image_height);
+			}
+			write_ppm(std::cout, image, image_width, image_height);
+			if (!aov_prefix.empty()) {
+				write_aovs(aovs);
+			}
+		}
 		std::clog << "\rDone.                \n";
 	}
+
+	//renders samples_per_pixel passes of one sample per pixel, each pass split by rows across render_threads.
+	//after every pass the running average goes to the shared framebuffer named preview_name (if set).
+	//image ends up averaged, aovs hold per pixel sums like render_pass leaves them
+	progressive_stats render_progressive(const hittable& world, const light_list& lights, std::vector<color>& image, aov_buffers& aovs) {
+		initialize(world);
+		progressive_stats stats;
+		auto start = std::chrono::steady_clock::now();
+		size_t pixel_count = size_t(image_width) * image_height;
+		image.assign(pixel_count, color(0, 0, 0));
+		aovs.clear(pixel_count);
+
+		shared_framebuffer preview;
+		bool publishing = !preview_name.empty() && preview.create(preview_name, image_width, image_height);
+		int threads = render_threads > 0 ? render_threads : int(std::thread::hardware_concurrency());
+		threads = std::max(1, std::min(threads, image_height));
+		//the same threads render every pass
+		worker_group workers(threads);
+
+		for (int pass = 0; pass < samples_per_pixel; pass++) {
+			std::clog << "\rPasses remaining: " << (samples_per_pixel - pass) << ' ' << std::flush;
+			//rows go to whichever thread asks next, and each thread copies its finished rows' averages
+			//straight into the preview's back buffer while they're still in cache
+			float* back = publishing ? preview.back_buffer() : nullptr;
+			float scale = 1.0f / (pass + 1);
+			//a wavefront covers whole rows, as many as fit in ray_batch
+			int rows_per_task = use_wavefront ? std::max(1, ray_batch / image_width) : 1;
+			std::atomic<int> next_row(0);
+			auto render_rows = [&](int) {
+				for (int j0 = next_row.fetch_add(rows_per_task); j0 < image_height; j0 = next_row.fetch_add(rows_per_task)) {
+					int j1 = std::min(j0 + rows_per_task, image_height);
+					if (use_wavefront) {
+						trace_wavefront(world, lights, image, &aovs, 0, j0, image_width, j1);
+					}
+					for (int j = j0; j < j1; j++) {
+						for (int i = 0; i < image_width; i++) {
+							size_t index = size_t(j) * image_width + i;
+							if (!use_wavefront) {
+								add_sample(i, j, world, lights, image[index], &aovs, index);
+							}
+							if (back) {
+								for (int c = 0; c < 3; c++) {
+									back[index * 3 + c] = float(image[index][c]) * scale;
+								}
+							}
+						}
+					}
+				}
+			};
+			workers.run(render_rows);
+
+			if (publishing) {
+				preview.publish(pass + 1);
+			}
+			if (pass == 0) {
+				stats.first_image_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			}
+			stats.passes++;
+		}
+		for (auto& pixel : image) {
+			pixel *= pixel_samples_scale;
+		}
+		stats.total_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		return stats;
+	}
+
+	//adds one sample per pixel into accum (row major, image_width wide) instead of writing a ppm
+	//lets benchmarks and progressive renders build up an image pass by pass
+	//aovs, if given, accumulate the first hit of each sample alongside the color
+	void render_pass(const hittable& world, const light_list& lights, std::vector<color>& accum, aov_buffers* aovs = nullptr) {
+		initialize(world);
+		size_t pixel_count = size_t(image_width) * image_height;
+		accum.resize(pixel_count);
+		if (aovs) {
+			aovs->resize(pixel_count);
+		}
+		if (use_wavefront) {
+			int rows_per_batch = std::max(1, ray_batch / image_width);
+			for (int j = 0; j < image_height; j += rows_per_batch) {
+				trace_wavefront(world, lights, accum, aovs, 0, j, image_width, std::min(j + rows_per_batch, image_height));
+			}
+			return;
+		}
+		for (int j = 0; j < image_height; j++) {
+			for (int i = 0; i < image_width; i++) {
+				size_t index = size_t(j) * image_width + i;
+				add_sample(i, j, world, lights, accum[index], aovs, index);
+			}
+		}
+	}
+
+	//sets the camera up for world without rendering anything, for callers that hand out tiles themselves
+	void prepare(const hittable& world) {
+		initialize(world);
+	}
+	//image height in pixels, valid once a render or prepare has run
+	int height() const {
+		return image_height;
+	}
+	//renders the pixels in [x0, x1) x [y0, y1) with samples_per_pixel samples each and stores their averages in image (row major, image_width wide).
+	//needs prepare first, and doesn't change the camera, so different tiles can render on different threads at once
+	void render_tile(const hittable& world, const light_list& lights, std::vector<color>& image, int x0, int y0, int x1, int y1) const {
+		if (use_wavefront) {
+			for (int j = y0; j < y1; j++) {
+				for (int i = x0; i < x1; i++) {
+					image[size_t(j) * image_width + i] = color(0, 0, 0);
+				}
+			}
+			for (int sample = 0; sample < samples_per_pixel; sample++) {
+				trace_wavefront(world, lights, image, nullptr, x0, y0, x1, y1);
+			}
+			for (int j = y0; j < y1; j++) {
+				for (int i = x0; i < x1; i++) {
+					image[size_t(j) * image_width + i] *= pixel_samples_scale;
+				}
+			}
+			return;
+		}
+		for (int j = y0; j < y1; j++) {
+			for (int i = x0; i < x1; i++) {
+				size_t index = size_t(j) * image_width + i;
+				color pixel_color(0, 0, 0);
+				for (int sample = 0; sample < samples_per_pixel; sample++) {
+					add_sample(i, j, world, lights, pixel_color, nullptr, 0);
+				}
+				image[index] = pixel_samples_scale * pixel_color;
+			}
+		}
+	}
+
+	//the per-sample kernel the last render picked, e.g. "defocus off, lambertian|metal"
+	std::string kernel_name() const {
+		return kernel_description;
+	}
 private:
+	enum class toggle { off, on, runtime };
+	typedef void (camera::*sample_kernel)(int, int, const hittable&, const light_list&, color&, aov_sample*) const;
 
 	int image_height; //rendered image height
 	double pixel_samples_scale; //color scale factor for a sum of pixel samlpes
@@ -77,8 +292,11 @@ private:
 	vec3 u, v, w; // camera frame basis vectors
 	vec3 defocus_disk_u; //defocus disk for horizontal radius
 	vec3 defocus_disk_v; //defocus disk for vertical radius
+	sample_kernel kernel = nullptr; //traces one sample, picked by choose_kernel
+	bool use_wavefront = false; //trace_wavefront instead of kernel, for batched worlds
+	std::string kernel_description;
 
-	void initialize() {
+	void initialize(const hittable& world) {
 		//make sure image height is at least 1
 		image_height = int(image_width / aspect_ratio);
 		image_height = (image_height < 1) ? 1 : image_height;
@@ -116,15 +334,75 @@ private:
 		auto defocus_radius = focus_dist * std::tan(degrees_to_radians(defocus_angle / 2));
 		defocus_disk_u = u * defocus_radius;
 		defocus_disk_v = v * defocus_radius;
+
+		choose_kernel(world);
+		use_wavefront = ray_batch > 0 && world.batched();
+		if (use_wavefront) {
+			kernel_description = "wavefront, virtual materials";
+		}
+	}
+
+	/*the dispatcher: looks at the camera settings and the materials in the scene and picks the
+	trace_sample instantiation that does the least work per sample. anything we don't have a
+	specialization for (a custom material) falls back to the generic version of that part.
+	the bounce limit stays a runtime value: paths almost always end early (a miss, an absorbed ray), so a compile time
+	limit saved nothing measurable, and it could only ever cover a few hand picked max_depth values*/
+	void choose_kernel(const hittable& world) {
+		kernel_description.clear();
+		if (!(specialize & specialize_defocus)) {
+			kernel = pick_materials<toggle::runtime>(world.material_kinds());
+			kernel_description = "defocus runtime" + kernel_description;
+		}
+		else if (defocus_angle > 0) {
+			kernel = pick_materials<toggle::on>(world.material_kinds());
+			kernel_description = "defocus on" + kernel_description;
+		}
+		else {
+			kernel = pick_materials<toggle::off>(world.material_kinds());
+			kernel_description = "defocus off" + kernel_description;
+		}
+	}
+	template <toggle Defocus>
+	sample_kernel pick_materials(unsigned kinds) {
+		if (specialize & specialize_materials) {
+			//the smallest set below that covers the scene, an unused kind only costs a branch that's never taken
+			const unsigned lm = lambertian_material | metal_material;
+			const unsigned lmd = lm | dielectric_material;
+			if ((kinds & ~lm) == 0) {
+				kernel_description = ", lambertian|metal";
+				return &camera::trace_sample<Defocus, lm>;
+			}
+			if ((kinds & ~(lm | light_material)) == 0) {
+				kernel_description = ", lambertian|metal|light";
+				return &camera::trace_sample<Defocus, lm | light_material>;
+			}
+			if ((kinds & ~lmd) == 0) {
+				kernel_description = ", lambertian|metal|dielectric";
+				return &camera::trace_sample<Defocus, lmd>;
+			}
+			if ((kinds & ~(lmd | light_material)) == 0) {
+				kernel_description = ", lambertian|metal|dielectric|light";
+				return &camera::trace_sample<Defocus, lmd | light_material>;
+			}
+		}
+		kernel_description = ", virtual materials";
+		return &camera::trace_sample<Defocus, 0>;
 	}
 	//constructs a ray originating from camera origin and directed at random sample point around pixel[i,j]
+	template <toggle Defocus>
 	ray get_ray(int i, int j) const {
 		//construct a camera ray originating from defocus disk and directed at a randomly sampled point
 		//around pixel location i, j.
 		auto offset = sample_square();
 		auto pixel_sample = pixel00_loc + ((i + offset.x()) * pixel_delta_u) + ((j + offset.y()) * pixel_delta_v);
 
-		auto ray_origin = (defocus_angle <= 0) ? center : defocus_disk_sample();
+		point3 ray_origin;
+		if (Defocus == toggle::runtime) {
+			ray_origin = (defocus_angle <= 0) ? center : defocus_disk_sample();
+		}
+		else {
+			ray_origin = (Defocus == toggle::off) ? center : defocus_disk_sample();
+		}
 		auto ray_direction = pixel_sample - ray_origin;
 
 		return ray(ray_origin, ray_direction);
@@ -140,22 +418,293 @@ private:
 
 	}
 
-	color ray_color(const ray& r, int depth, const hittable& world) const {
-		//hit the ray bounce limit, so no more light should be gathered
-		if (depth <= 0) {
-			return color(0, 0, 0);
+	//traces one camera sample through pixel i, j and adds it (and its first hit, if aovs is set) to the buffers
+	void add_sample(int i, int j, const hittable& world, const light_list& lights, color& pixel, aov_buffers* aovs, size_t index) const {
+		if (!aovs) {
+			(this->*kernel)(i, j, world, lights, pixel, nullptr);
+			return;
 		}
-		hit_record rec;
-		//ignore hits below 0.001 to account for shadow acne problem
-		if (world.hit(r, interval(0.001, infinity), rec)) {
+		aov_sample first_hit;
+		(this->*kernel)(i, j, world, lights, pixel, &first_hit);
+		aovs->add(index, first_hit);
+	}
+
+	//writes the AOVs as viewable ppms: normals mapped from [-1, 1] to [0, 1], depth as grey scaled to the farthest hit
+	void write_aovs(const aov_buffers& aovs) const {
+		size_t pixel_count = aovs.albedo.size();
+		std::vector<color> normals(pixel_count), depths(pixel_count);
+		double max_depth_seen = 0;
+		for (size_t k = 0; k < pixel_count; k++) {
+			max_depth_seen = std::fmax(max_depth_seen, aovs.depth[k]);
+		}
+		for (size_t k = 0; k < pixel_count; k++) {
+			normals[k] = 0.5 * (aovs.normal[k] + vec3(1, 1, 1));
+			auto d = (max_depth_seen > 0) ? aovs.depth[k] / max_depth_seen : 0;
+			depths[k] = color(d, d, d);
+		}
+		std::ofstream albedo_out(aov_prefix + "_albedo.ppm");
+		write_ppm(albedo_out, aovs.albedo, image_width, image_height);
+		std::ofstream normal_out(aov_prefix + "_normal.ppm");
+		write_ppm(normal_out, normals, image_width, image_height, false);
+		std::ofstream depth_out(aov_prefix + "_depth.ppm");
+		write_ppm(depth_out, depths, image_width, image_height, false);
+	}
+
+	/*one camera sample through pixel i, j, added to pixel. first_hit, if set, receives the AOVs of the surface the camera ray hits.
+	this is the hot loop, so it's compiled per feature set (see choose_kernel):
+	Defocus decides the camera ray origin at compile time unless it's runtime,
+	Materials is the material_kind mask the scene is made of (0 for virtual calls),
+	each bounce adds its emission and light sample scaled by the throughput of the path so far*/
+	template <toggle Defocus, unsigned Materials>
+	void trace_sample(int i, int j, const hittable& world, const light_list& lights, color& pixel, aov_sample* first_hit) const {
+		ray r = get_ray<Defocus>(i, j);
+		//with a known material set, a scene without lights can't emit anything
+		const bool may_emit = (Materials == 0) || (Materials & light_material);
+		color radiance(0, 0, 0);
+		color throughput(1, 1, 1);
+		//pdf of the bounce that produced r, 0 for camera rays and specular bounces
+		double bsdf_pdf = 0;
+		//hit the ray bounce limit, so no more light should be gathered
+		for (int depth = 0; depth < max_depth; depth++) {
+			hit_record rec;
+			//ignore hits below 0.001 to account for shadow acne problem
+			if (!world.hit(r, interval(0.001, infinity), rec)) {
+				radiance += throughput * miss_color(r, lights, bsdf_pdf);
+				break;
+			}
+			const material& mat = *rec.mat;
+
+			if (depth == 0 && first_hit) {
+				first_hit->albedo = visit_material<Materials>(mat, [&](const auto& m) { return m.base_color(rec); });
+				first_hit->normal = rec.normal;
+				first_hit->depth = rec.t * r.direction().length();
+			}
+
+			if (may_emit) {
+				radiance += throughput * emission<Materials>(r, rec, lights, bsdf_pdf);
+			}
+
+			//light sampling comes first: a rough surface whose bsdf sample fails (GGX reflecting below the horizon)
+			//still sees the lights. specular surfaces can't, the only way they find a light is by bouncing into it
+			if (!visit_material<Materials>(mat, [&](const auto& m) { return m.is_specular(); })) {
+				radiance += throughput * sample_lights<Materials>(r, rec, world, lights);
+			}
+
 			//account for material type and how the ray should behave when coming in contact with the surface
-			ray scattered;
-			color attenuation;
-			if (rec.mat->scatter(r, rec, attenuation, scattered)) {
-				return attenuation * ray_color(scattered, depth - 1, world);
+			scatter_record srec;
+			if (!visit_material<Materials>(mat, [&](const auto& m) { return m.scatter(r, rec, srec); })) {
+				break;
 			}
+			throughput = throughput * srec.attenuation;
+			r = srec.scattered;
+			bsdf_pdf = srec.pdf;
+		}
+		pixel += radiance;
+	}
+
+	/*one sample for every pixel in [x0, x1) x [y0, y1), added to accum (and aovs, if set) like add_sample does,
+	but traced a bounce at a time for all of them together: each bounce's rays go to world.hit_batch in one call,
+	then all of that bounce's shadow rays in another, so an out of core scene reads each chunk once per bounce
+	instead of once per ray. same math as trace_sample, with virtual material calls*/
+	void trace_wavefront(const hittable& world, const light_list& lights, std::vector<color>& accum, aov_buffers* aovs, int x0, int y0, int x1, int y1) const {
+		struct path {
+			size_t pixel;
+			color throughput;
+			double bsdf_pdf;
+		};
+		std::vector<path> paths, next_paths;
+		std::vector<ray> rays, next_rays, shadow_rays;
+		for (int j = y0; j < y1; j++) {
+			for (int i = x0; i < x1; i++) {
+				paths.push_back({ size_t(j) * image_width + i, color(1, 1, 1), 0 });
+				rays.push_back(get_ray<toggle::runtime>(i, j));
+			}
+		}
+		std::vector<hit_record> recs, light_recs;
+		std::vector<char> hits, light_hits;
+		std::vector<light_sample> samples;
+		for (int depth = 0; depth < max_depth && !rays.empty(); depth++) {
+			world.hit_batch(rays, interval(0.001, infinity), recs, hits);
+			next_paths.clear();
+			next_rays.clear();
+			samples.clear();
+			shadow_rays.clear();
+			for (size_t k = 0; k < rays.size(); k++) {
+				const path& current = paths[k];
+				const ray& r = rays[k];
+				if (!hits[k]) {
+					if (depth == 0 && aovs) {
+						aovs->add(current.pixel, aov_sample());
+					}
+					accum[current.pixel] += current.throughput * miss_color(r, lights, current.bsdf_pdf);
+					continue;
+				}
+				const hit_record& rec = recs[k];
+				if (depth == 0 && aovs) {
+					aov_sample first_hit;
+					first_hit.albedo = rec.mat->base_color(rec);
+					first_hit.normal = rec.normal;
+					first_hit.depth = rec.t * r.direction().length();
+					aovs->add(current.pixel, first_hit);
+				}
+				accum[current.pixel] += current.throughput * emission<0>(r, rec, lights, current.bsdf_pdf);
+
+				//light sample before the bounce, as in trace_sample
+				light_sample sample;
+				if (!rec.mat->is_specular() && start_light_sample<0>(r, rec, lights, sample)) {
+					sample.pixel = current.pixel;
+					sample.factor = current.throughput * sample.factor;
+					samples.push_back(sample);
+					shadow_rays.push_back(sample.shadow_ray);
+				}
+				scatter_record srec;
+				if (!rec.mat->scatter(r, rec, srec)) {
+					continue;
+				}
+				next_paths.push_back({ current.pixel, current.throughput * srec.attenuation, srec.pdf });
+				next_rays.push_back(srec.scattered);
+			}
+			if (!shadow_rays.empty()) {
+				world.hit_batch(shadow_rays, interval(0.001, infinity), light_recs, light_hits);
+				for (size_t k = 0; k < samples.size(); k++) {
+					accum[samples[k].pixel] += finish_light_sample<0>(samples[k], light_hits[k] != 0, light_recs[k]);
+				}
+			}
+			std::swap(paths, next_paths);
+			std::swap(rays, next_rays);
+		}
+	}
+
+	//light the surface gives off towards r, bsdf_pdf as in trace_sample
+	template <unsigned Materials>
+	color emission(const ray& r, const hit_record& rec, const light_list& lights, double bsdf_pdf) const {
+		color color_from_emission = visit_material<Materials>(*rec.mat, [&](const auto& m) { return m.emitted(r, rec); });
+		if (bsdf_pdf > 0 && !lights.empty() && color_from_emission.length_squared() > 0) {
+			//light sampling at the previous bounce could have found this light too,
+			//so weight it (multiple importance sampling) to keep from counting it twice
+			auto light_pdf = (1 - environment_select_prob(lights)) * lights.pdf_value(rec.object, r.origin(), r.direction());
+			color_from_emission = power_heuristic(bsdf_pdf, light_pdf) * color_from_emission;
+		}
+		return color_from_emission;
+	}
+
+	//what a ray that escapes the scene sees, bsdf_pdf as in trace_sample
+	color miss_color(const ray& r, const light_list& lights, double bsdf_pdf) const {
+		if (!has_environment()) {
+			return background_color(r);
+		}
+		auto env_color = environment->value(r.direction());
+		if (bsdf_pdf > 0) {
+			//the environment is a light too, weight it against environment sampling at the previous bounce
+			auto light_pdf = environment_select_prob(lights) * environment->pdf_value(r.direction());
+			env_color = power_heuristic(bsdf_pdf, light_pdf) * env_color;
+		}
+		return env_color;
+	}
+
+	//a shadow ray towards a light, waiting to find out whether it gets there
+	struct light_sample {
+		ray shadow_ray;
+		color factor; //MIS weight * bsdf * cos / pdf, times the light's color if the ray reaches it
+		const hittable* light = nullptr; //the light we aimed at, nullptr for the environment
+		size_t pixel = 0; //for trace_wavefront
+	};
+
+	//next event estimation: fire a shadow ray straight at a light instead of waiting for a bounce to hit one by chance
+	template <unsigned Materials>
+	color sample_lights(const ray& r_in, const hit_record& rec, const hittable& world, const light_list& lights) const {
+		light_sample sample;
+		if (!start_light_sample<Materials>(r_in, rec, lights, sample)) {
 			return color(0, 0, 0);
 		}
+		hit_record light_rec;
+		bool blocked = world.hit(sample.shadow_ray, interval(0.001, infinity), light_rec);
+		return finish_light_sample<Materials>(sample, blocked, light_rec);
+	}
+
+	//picks a light (with both an environment and scene lights around, we flip a coin between them)
+	//and sets up the shadow ray. false if there's nothing worth tracing
+	template <unsigned Materials>
+	bool start_light_sample(const ray& r_in, const hit_record& rec, const light_list& lights, light_sample& sample) const {
+		auto env_prob = environment_select_prob(lights);
+		bool use_environment = env_prob > 0 && random_double() < env_prob;
+
+		vec3 direction;
+		double light_pdf;
+		const hittable* light = nullptr;
+		if (use_environment) {
+			direction = environment->sample(light_pdf);
+			light_pdf *= env_prob;
+		}
+		else {
+			if (!lights.sample(rec.p, direction, light_pdf, light)) {
+				return false;
+			}
+			light_pdf *= 1 - env_prob;
+		}
+		if (light_pdf <= 0) {
+			return false;
+		}
+
+		ray shadow_ray(rec.p, direction);
+		const material& mat = *rec.mat;
+		auto bsdf_pdf = visit_material<Materials>(mat, [&](const auto& m) { return m.scattering_pdf(r_in, rec, shadow_ray); });
+		if (bsdf_pdf <= 0) {
+			//light is behind the surface, or somewhere the material never reflects to
+			return false;
+		}
+		auto weight = power_heuristic(light_pdf, bsdf_pdf);
+		auto bsdf_cos = visit_material<Materials>(mat, [&](const auto& m) { return m.eval(r_in, rec, shadow_ray); });
+		sample.shadow_ray = shadow_ray;
+		sample.factor = (weight / light_pdf) * bsdf_cos;
+		sample.light = light;
+		return true;
+	}
+
+	//what the shadow ray brings back, given what (if anything) it hit
+	template <unsigned Materials>
+	color finish_light_sample(const light_sample& sample, bool blocked, const hit_record& light_rec) const {
+		color light_color;
+		if (!sample.light) {
+			//the environment is only visible if the shadow ray escapes the scene
+			if (blocked) {
+				return color(0, 0, 0);
+			}
+			light_color = environment->value(sample.shadow_ray.direction());
+		}
+		else {
+			if (!blocked || light_rec.object != sample.light) {
+				//something is in the way
+				return color(0, 0, 0);
+			}
+			light_color = visit_material<Materials>(*light_rec.mat, [&](const auto& m) { return m.emitted(sample.shadow_ray, light_rec); });
+		}
+		return sample.factor * light_color;
+	}
+
+	bool has_environment() const {
+		return environment && !environment->empty();
+	}
+
+	//chance of sampling the environment instead of a scene light
+	double environment_select_prob(const light_list& lights) const {
+		if (!has_environment()) {
+			return 0;
+		}
+		return lights.empty() ? 1 : 0.5;
+	}
+
+	//veach's power heuristic (beta = 2), weight for a sample from the strategy with pdf a
+	static double power_heuristic(double a, double b) {
+		auto a2 = a * a;
+		auto b2 = b * b;
+		return (a2 + b2 > 0) ? a2 / (a2 + b2) : 0;
+	}
+
+	color background_color(const ray& r) const {
+		if (!sky_gradient) {
+			return background;
+		}
 		//no hit, draw background gradient
 		vec3 unit_direction = unit_vector(r.direction());
 		auto a = 0.5 * (unit_direction.y() + 1.0);
@@ -3,6 +3,8 @@
 #include "interval.h"
 #include "vec3.h"
 
+#include <vector>
+
 
 using color = vec3;
 
@@ -17,7 +19,8 @@ inline double linear_to_gamma(double linear_component) {
 
 
 //write's color to output
-void write_color(std::ostream& out, const color& pixel_color) {
+//gamma_correct is only turned off for data images (normals, depth) that are already in [0, 1]
+void write_color(std::ostream& out, const color& pixel_color, bool gamma_correct = true) {
 	auto r = pixel_color.x();
 	auto g = pixel_color.y();
 	auto b = pixel_color.z();
@@ -28,9 +31,11 @@ void write_color(std::ostream& out, const color& pixel_color) {
 	if we don't gamma correct it our image is in "linear space" as
 	opposed to "gamma space" this results in a much darker image than intended
 	for our use case.*/
-	r = linear_to_gamma(r);
-	g = linear_to_gamma(g);
-	b = linear_to_gamma(b);
+	if (gamma_correct) {
+		r = linear_to_gamma(r);
+		g = linear_to_gamma(g);
+		b = linear_to_gamma(b);
+	}
 
 	//translate from [0, 1] to [0, 255]
 	static const interval intensity(0.000, 0.999);
@@ -42,4 +47,12 @@ void write_color(std::ostream& out, const color& pixel_color) {
 	out << rbyte << ' ' << gbyte << ' ' << bbyte << '\n';
 }
 
+//writes a whole row major image as a P3 ppm
+inline void write_ppm(std::ostream& out, const std::vector<color>& pixels, int width, int height, bool gamma_correct = true) {
+	out << "P3\n" << width << ' ' << height << "\n255\n";
+	for (size_t k = 0; k < size_t(width) * height; k++) {
+		write_color(out, pixels[k], gamma_correct);
+	}
+}
+
 #endif
\ No newline at end of file
@@ -2,12 +2,15 @@
 #define CONSTS_N_UTILS_H
 //file for all our constants and useful util functions
 
+#include <atomic>
 #include <cmath>
-//we'll opt for implementing random doubles using the C functions instead of the C++ <random> ones
 #include <cstdlib>
 #include <iostream>
 #include <limits>
 #include <memory>
+//random doubles used to come from std::rand, but that's one shared (and on some platforms locked) state,
+//which render threads would fight over. <random> lets every thread have its own generator
+#include <random>
 
 //C++ std::usings
 
@@ -27,7 +30,11 @@ inline double degrees_to_radians(double degrees) {
 
 //returns a random double between [0, 1).
 inline double random_double() {
-	return std::rand() / (RAND_MAX + 1.0);
+	//each thread seeds its own generator from a shared counter, so threads never repeat each other's samples
+	static std::atomic<unsigned> threads_seeded(0);
+	thread_local std::mt19937 generator(5489u + 7919u * threads_seeded++);
+	thread_local std::uniform_real_distribution<double> distribution(0.0, 1.0);
+	return distribution(generator);
 }
 //returns a random double in the interval [min, max)
 inline double random_double(double min, double max) {
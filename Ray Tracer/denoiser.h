@@ -0,0 +1,181 @@
+#ifndef DENOISER_H
+#define DENOISER_H
+/*Edge-avoiding a-trous wavelet denoiser (Dammertz et al. 2010, "Edge-Avoiding A-Trous Wavelet Transform
+for fast Global Illumination Filtering").
+Each pass blurs with a 5x5 B3 spline kernel whose taps are spread 2^pass pixels apart ("a trous" = with holes),
+so 5 passes cover an 81x81 neighborhood for the cost of 5 * 25 taps a pixel.
+Every tap is weighted down when its color, normal, depth or albedo differs from the center pixel,
+which keeps the blur from crossing geometric edges and texture detail.
+
+Before filtering we divide the color by the albedo (demodulation), so the filter only has to smooth lighting,
+and multiply it back afterwards so textures stay sharp.
+
+The image is converted to one float array per channel so the inner loop walks contiguous memory
+with no branches, which compilers turn into SIMD code, and rows are split across threads.*/
+#include "consts_n_utils.h"
+#include "aov_buffers.h"
+#include "worker_group.h"
+
+#include <algorithm>
+#include <memory>
+#include <thread>
+#include <vector>
+
+class denoiser {
+public:
+	int passes = 5; //number of a-trous iterations, the filter footprint doubles with each one
+	double sigma_color = 0.6; //how different (demodulated) colors can be before we stop blurring across them, halves every pass
+	double sigma_normal = 0.3; //same for normals
+	double sigma_depth = 0.1; //relative depth difference
+	double sigma_albedo = 0.1; //same for albedo
+	int thread_count = 0; //0 means one per hardware thread
+
+	//filters image in place, aovs must hold per pixel averages (not sums) for the same resolution
+	void run(std::vector<color>& image, const aov_buffers& aovs, int width, int height) {
+		w = width;
+		h = height;
+		size_t n = size_t(w) * h;
+		for (auto plane : { &r, &g, &b, &nx, &ny, &nz, &z, &ar, &ag, &ab, &out_r, &out_g, &out_b }) {
+			plane->assign(n, 0.0f);
+		}
+
+		//split into planes and demodulate
+		for (size_t k = 0; k < n; k++) {
+			for (int c = 0; c < 3; c++) {
+				float a = float(aovs.albedo[k][c]);
+				albedo_plane(c)[k] = a;
+				color_plane(r, g, b, c)[k] = float(image[k][c]) / (a + albedo_epsilon);
+			}
+			nx[k] = float(aovs.normal[k].x());
+			ny[k] = float(aovs.normal[k].y());
+			nz[k] = float(aovs.normal[k].z());
+			z[k] = float(aovs.depth[k]);
+		}
+
+		for (int pass = 0; pass < passes; pass++) {
+			int step = 1 << pass;
+			//the color tolerance shrinks as the noise goes down
+			float sc = float(sigma_color / (1 << pass));
+			run_rows_threaded(step, 1 / (sc * sc));
+			std::swap(r, out_r);
+			std::swap(g, out_g);
+			std::swap(b, out_b);
+		}
+
+		//remodulate
+		for (size_t k = 0; k < n; k++) {
+			for (int c = 0; c < 3; c++) {
+				image[k][c] = double(color_plane(r, g, b, c)[k]) * (albedo_plane(c)[k] + albedo_epsilon);
+			}
+		}
+	}
+
+private:
+	static constexpr float albedo_epsilon = 1e-3f;
+
+	//scratch planes, kept around between runs so the progressive and benchmark paths don't reallocate
+	int w = 0, h = 0;
+	std::vector<float> r, g, b, nx, ny, nz, z, ar, ag, ab, out_r, out_g, out_b;
+	std::unique_ptr<worker_group> workers;
+
+	std::vector<float>& albedo_plane(int c) { return c == 0 ? ar : (c == 1 ? ag : ab); }
+	static std::vector<float>& color_plane(std::vector<float>& x, std::vector<float>& y, std::vector<float>& zz, int c) {
+		return c == 0 ? x : (c == 1 ? y : zz);
+	}
+
+	//exp(-x) for x >= 0 as 1 / (1 + x / 256)^256, a handful of multiplies that vectorize where std::exp usually won't.
+	//plenty accurate for filter weights, and large x still goes smoothly to 0
+	static float fast_exp_neg(float x) {
+		float t = 1.0f + x * (1.0f / 256.0f);
+		t *= t; t *= t; t *= t; t *= t;
+		t *= t; t *= t; t *= t; t *= t;
+		return 1.0f / t;
+	}
+
+	//splits the rows across the worker group, which is started on the first run and reused by every pass after
+	void run_rows_threaded(int step, float inv_sc2) {
+		int threads = thread_count > 0 ? thread_count : int(std::thread::hardware_concurrency());
+		threads = std::max(1, std::min(threads, h));
+		if (!workers || workers->size() != threads) {
+			workers.reset(new worker_group(threads));
+		}
+		workers->run([=](int t) {
+			filter_rows(h * t / threads, h * (t + 1) / threads, step, inv_sc2);
+		});
+	}
+
+	//one row of every guide and color plane
+	struct plane_rows {
+		const float *r, *g, *b, *nx, *ny, *nz, *z, *ar, *ag, *ab;
+	};
+
+	plane_rows rows_at(size_t row) const {
+		return { &r[row], &g[row], &b[row], &nx[row], &ny[row], &nz[row], &z[row], &ar[row], &ag[row], &ab[row] };
+	}
+
+	//adds one kernel tap (offset dx into row q) to the sums of every pixel in row p, over x in [x0, x1)
+	//the sums are __restrict so the compiler knows they never overlap the planes and can vectorize
+	//the loop without runtime overlap checks (there are too many planes for it to check them all)
+	static void accumulate_tap(const plane_rows& p, const plane_rows& q, int x0, int x1, int dx, float k,
+		float inv_sc2, float inv_sn2, float inv_sa2, float inv_sz,
+		float* __restrict sr, float* __restrict sg, float* __restrict sb, float* __restrict sw) {
+		for (int x = x0; x < x1; x++) {
+			int qx = x + dx;
+			float dr = p.r[x] - q.r[qx], dg = p.g[x] - q.g[qx], db = p.b[x] - q.b[qx];
+			float dnx = p.nx[x] - q.nx[qx], dny = p.ny[x] - q.ny[qx], dnz = p.nz[x] - q.nz[qx];
+			float dar = p.ar[x] - q.ar[qx], dag = p.ag[x] - q.ag[qx], dab = p.ab[x] - q.ab[qx];
+			float dz = std::fabs(p.z[x] - q.z[qx]) / (std::max(p.z[x], q.z[qx]) + 1e-4f);
+			//every edge stopping term is an exp, so they fold into a single exp of the summed exponents
+			float e = (dr * dr + dg * dg + db * db) * inv_sc2
+				+ (dnx * dnx + dny * dny + dnz * dnz) * inv_sn2
+				+ (dar * dar + dag * dag + dab * dab) * inv_sa2
+				+ dz * inv_sz;
+			float weight = k * fast_exp_neg(e);
+			sr[x] += weight * q.r[qx];
+			sg[x] += weight * q.g[qx];
+			sb[x] += weight * q.b[qx];
+			sw[x] += weight;
+		}
+	}
+
+	void filter_rows(int y0, int y1, int step, float inv_sc2) {
+		static const float kernel[5] = { 1.0f / 16, 1.0f / 4, 3.0f / 8, 1.0f / 4, 1.0f / 16 };
+		float inv_sn2 = float(1 / (sigma_normal * sigma_normal));
+		float inv_sa2 = float(1 / (sigma_albedo * sigma_albedo));
+		float inv_sz = float(1 / sigma_depth);
+
+		std::vector<float> sum_r(w), sum_g(w), sum_b(w), sum_w(w);
+		for (int y = y0; y < y1; y++) {
+			std::fill(sum_r.begin(), sum_r.end(), 0.0f);
+			std::fill(sum_g.begin(), sum_g.end(), 0.0f);
+			std::fill(sum_b.begin(), sum_b.end(), 0.0f);
+			std::fill(sum_w.begin(), sum_w.end(), 0.0f);
+			size_t row = size_t(y) * w;
+
+			for (int j = 0; j < 5; j++) {
+				int qy = y + (j - 2) * step;
+				if (qy < 0 || qy >= h) {
+					continue;
+				}
+				for (int i = 0; i < 5; i++) {
+					int dx = (i - 2) * step;
+					//only the x range where x + dx stays in the image, so the loop below needs no bounds checks
+					int x0 = std::max(0, -dx);
+					int x1 = std::min(w, w - dx);
+					float k = kernel[i] * kernel[j];
+					size_t qrow = size_t(qy) * w;
+					accumulate_tap(rows_at(row), rows_at(qrow), x0, x1, dx, k, inv_sc2, inv_sn2, inv_sa2, inv_sz,
+						sum_r.data(), sum_g.data(), sum_b.data(), sum_w.data());
+				}
+			}
+			for (int x = 0; x < w; x++) {
+				//the center tap always has weight kernel[2]^2 > 0, so sum_w can't be 0
+				out_r[row + x] = sum_r[x] / sum_w[x];
+				out_g[row + x] = sum_g[x] / sum_w[x];
+				out_b[row + x] = sum_b[x] / sum_w[x];
+			}
+		}
+	}
+};
+
+#endif
@@ -0,0 +1,114 @@
+#ifndef DISTRIBUTION_H
+#define DISTRIBUTION_H
+//piecewise constant 2D distribution over [0,1)^2, used to importance sample images (environment maps)
+//picks a row from the marginal distribution, then a column from that row's conditional distribution.
+//all the rows live in one flat array so a lookup touches two short contiguous runs of memory,
+//and we store floats since the table can be as large as the image itself
+#include "consts_n_utils.h"
+
+#include <algorithm>
+#include <vector>
+
+class distribution_2d {
+public:
+	distribution_2d() {}
+
+	//f is row major, nu columns by nv rows, every entry should be >= 0
+	distribution_2d(const std::vector<double>& f, int nu, int nv) : nu(nu), nv(nv) {
+		func.resize(size_t(nu) * nv);
+		cdf.resize(size_t(nu + 1) * nv);
+		row_integral.resize(nv);
+		for (int v = 0; v < nv; v++) {
+			for (int u = 0; u < nu; u++) {
+				func[index(u, v)] = float(f[index(u, v)]);
+			}
+			row_integral[v] = float(build_cdf(&func[index(0, v)], nu, &cdf[size_t(v) * (nu + 1)]));
+		}
+		marginal_cdf.resize(nv + 1);
+		marginal_integral = build_cdf(row_integral.data(), nv, marginal_cdf.data());
+	}
+
+	bool empty() const { return func.empty(); }
+
+	//maps two uniform numbers to a point (u, v) in [0,1)^2, pdf is with respect to area in [0,1)^2
+	void sample(double r1, double r2, double& u, double& v, double& pdf) const {
+		double pdf_v, pdf_u;
+		int row;
+		v = sample_continuous(row_integral.data(), marginal_cdf.data(), nv, marginal_integral, r1, pdf_v, row);
+		int column;
+		u = sample_continuous(&func[index(0, row)], &cdf[size_t(row) * (nu + 1)], nu, row_integral[row], r2, pdf_u, column);
+		pdf = pdf_u * pdf_v;
+	}
+
+	//density at (u, v), matches what sample() returns
+	double pdf(double u, double v) const {
+		int iu = std::min(std::max(int(u * nu), 0), nu - 1);
+		int iv = std::min(std::max(int(v * nv), 0), nv - 1);
+		if (marginal_integral <= 0) {
+			return 1;
+		}
+		return func[index(iu, iv)] / marginal_integral;
+	}
+
+	//bytes held by the tables, for benchmark reports
+	size_t memory_bytes() const {
+		return (func.size() + cdf.size() + row_integral.size() + marginal_cdf.size()) * sizeof(float);
+	}
+
+private:
+	int nu = 0, nv = 0;
+	std::vector<float> func; //the function values, row major
+	std::vector<float> cdf; //nu + 1 entries per row
+	std::vector<float> row_integral; //integral of each row, which is also the marginal function
+	std::vector<float> marginal_cdf;
+	double marginal_integral = 0;
+
+	size_t index(int u, int v) const { return size_t(v) * nu + u; }
+
+	//fills cdf (n + 1 entries) and returns the integral of f over [0,1)
+	//a row with nothing in it becomes uniform so it can still be sampled
+	static double build_cdf(const float* f, int n, float* cdf) {
+		double running = 0;
+		cdf[0] = 0;
+		for (int i = 0; i < n; i++) {
+			running += double(f[i]) / n;
+			cdf[i + 1] = float(running);
+		}
+		if (running <= 0) {
+			for (int i = 1; i <= n; i++) {
+				cdf[i] = float(double(i) / n);
+			}
+		}
+		else {
+			for (int i = 1; i <= n; i++) {
+				cdf[i] = float(cdf[i] / running);
+			}
+		}
+		cdf[n] = 1;
+		return running;
+	}
+
+	//inverts the cdf with a binary search, then places the sample linearly inside the chosen bucket.
+	//the search and the offset into the bucket both use r rounded to float like the table, otherwise r can round up
+	//past a bucket's start, land in the bucket before it, and come back with the wrong bucket's pdf
+	static double sample_continuous(const float* f, const float* cdf, int n, double integral, double r, double& pdf, int& offset) {
+		float rf = float(r);
+		//last bucket whose cdf is <= r
+		offset = int(std::upper_bound(cdf, cdf + n + 1, rf) - cdf) - 1;
+		offset = std::min(std::max(offset, 0), n - 1);
+		double du = double(rf) - double(cdf[offset]);
+		double width = double(cdf[offset + 1]) - double(cdf[offset]);
+		if (width > 0) {
+			du /= width;
+		}
+		//stay strictly inside the bucket so the point and the pdf agree
+		du = std::min(std::max(du, 0.0), 1.0 - 1e-6);
+		double x = std::min((offset + du) / n, 1.0 - 1e-9);
+		//the pdf is the one of the bucket x really ended up in, the same lookup pdf() does
+		offset = std::min(std::max(int(x * n), 0), n - 1);
+		pdf = (integral > 0) ? f[offset] / integral : 1;
+		return x;
+	}
+};
+
+#endif
@@ -0,0 +1,118 @@
+#ifndef ENVIRONMENT_LIGHT_H
+#define ENVIRONMENT_LIGHT_H
+//light coming from infinitely far away in every direction, stored as a lat-long (equirectangular) HDR image.
+//it answers two questions: what color does a ray that escapes the scene see (lookups from misses),
+//and which direction should we aim a shadow ray (sampling for next event estimation).
+//bright texels get sampled more often, so a small sun in a big dim sky still converges quickly
+#include "consts_n_utils.h"
+#include "distribution.h"
+#include "hdr_image.h"
+
+#include <string>
+
+class environment_light {
+public:
+	double intensity = 1.0; //scales every texel, handy for maps that are too bright or dark
+	bool importance_sampling = true; //if false pick directions uniformly over the sphere (only useful for comparisons)
+
+	environment_light() {}
+	environment_light(hdr_image image) : image(std::move(image)) { build_distribution(); }
+
+	//loads the map from a PFM or .hdr file and builds the sampling tables, returns false if the file can't be read
+	bool load(const std::string& filename) {
+		if (!image.load(filename)) {
+			return false;
+		}
+		build_distribution();
+		return true;
+	}
+
+	bool empty() const { return image.empty(); }
+
+	//radiance arriving from direction
+	color value(const vec3& direction) const {
+		if (empty()) {
+			return color(0, 0, 0);
+		}
+		double u, v;
+		direction_to_uv(unit_vector(direction), u, v);
+		int x = std::min(int(u * image.width()), image.width() - 1);
+		int y = std::min(int(v * image.height()), image.height() - 1);
+		return intensity * image.pixel(x, y);
+	}
+
+	//picks a direction towards the environment, pdf is in solid angle
+	vec3 sample(double& pdf) const {
+		if (!importance_sampling || distribution.empty()) {
+			pdf = 1 / (4 * pi);
+			return random_unit_vector();
+		}
+		double u, v, map_pdf;
+		distribution.sample(random_double(), random_double(), u, v, map_pdf);
+		vec3 direction = uv_to_direction(u, v);
+		pdf = to_solid_angle(map_pdf, v);
+		return direction;
+	}
+
+	//solid angle pdf of sample() returning direction
+	double pdf_value(const vec3& direction) const {
+		if (!importance_sampling || distribution.empty()) {
+			return 1 / (4 * pi);
+		}
+		double u, v;
+		direction_to_uv(unit_vector(direction), u, v);
+		return to_solid_angle(distribution.pdf(u, v), v);
+	}
+
+	//bytes for the image and the sampling tables
+	size_t memory_bytes() const {
+		return image.memory_bytes() + distribution.memory_bytes();
+	}
+
+private:
+	hdr_image image;
+	distribution_2d distribution;
+
+	//weight each texel by its brightness times the solid angle it covers,
+	//rows near the poles are squashed into a tiny area of the sphere so they count for less
+	void build_distribution() {
+		int w = image.width();
+		int h = image.height();
+		std::vector<double> weights(size_t(w) * h);
+		for (int y = 0; y < h; y++) {
+			auto sin_theta = std::sin(pi * (y + 0.5) / h);
+			for (int x = 0; x < w; x++) {
+				color c = image.pixel(x, y);
+				auto luminance = 0.2126 * c.x() + 0.7152 * c.y() + 0.0722 * c.z();
+				weights[size_t(y) * w + x] = std::fmax(luminance, 0.0) * sin_theta;
+			}
+		}
+		distribution = distribution_2d(weights, w, h);
+	}
+
+	//u goes around the horizon (0 and 1 both face -x), v goes from straight up (0) to straight down (1)
+	static void direction_to_uv(const vec3& d, double& u, double& v) {
+		auto theta = std::acos(std::fmin(std::fmax(d.y(), -1.0), 1.0));
+		auto phi = std::atan2(-d.z(), d.x()) + pi;
+		u = phi / (2 * pi);
+		v = theta / pi;
+	}
+
+	static vec3 uv_to_direction(double u, double v) {
+		auto theta = v * pi;
+		auto phi = u * 2 * pi;
+		auto sin_theta = std::sin(theta);
+		return vec3(-sin_theta * std::cos(phi), std::cos(theta), sin_theta * std::sin(phi));
+	}
+
+	//the lat-long mapping stretches each texel over 2 pi^2 sin(theta) of solid angle
+	static double to_solid_angle(double map_pdf, double v) {
+		auto sin_theta = std::sin(v * pi);
+		if (sin_theta <= 0) {
+			return 0;
+		}
+		return map_pdf / (2 * pi * pi * sin_theta);
+	}
+};
+
+#endif
@@ -0,0 +1,232 @@
+#ifndef HDR_IMAGE_H
+#define HDR_IMAGE_H
+//floating point rgb image loaded from a PFM or Radiance .hdr file
+//pixels are kept as packed floats, row major with row 0 at the top, 12 bytes a pixel instead of the 24 a color would take
+#include "consts_n_utils.h"
+
+#include <cctype>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+class hdr_image {
+public:
+	hdr_image() {}
+	//wraps pixels we already have, data must hold width * height * 3 floats
+	hdr_image(int width, int height, std::vector<float> data) : w(width), h(height), data(std::move(data)) {}
+
+	//picks the loader from the file extension, prints an error and returns false if anything goes wrong
+	bool load(const std::string& filename) {
+		auto dot = filename.find_last_of('.');
+		auto ext = (dot == std::string::npos) ? std::string() : filename.substr(dot + 1);
+		for (auto& c : ext) c = char(std::tolower(c));
+
+		bool ok = false;
+		if (ext == "pfm") ok = load_pfm(filename);
+		else if (ext == "hdr" || ext == "pic") ok = load_hdr(filename);
+		else std::cerr << "ERROR: unknown image format '" << filename << "', expected .pfm or .hdr\n";
+
+		if (!ok) {
+			w = h = 0;
+			data.clear();
+		}
+		return ok;
+	}
+
+	int width() const { return w; }
+	int height() const { return h; }
+	bool empty() const { return data.empty(); }
+	size_t memory_bytes() const { return data.size() * sizeof(float); }
+
+	color pixel(int x, int y) const {
+		const float* p = &data[(size_t(y) * w + x) * 3];
+		return color(p[0], p[1], p[2]);
+	}
+
+	//writes the image as a little endian rgb PFM
+	bool save_pfm(const std::string& filename) const {
+		std::ofstream out(filename, std::ios::binary);
+		if (!out) {
+			std::cerr << "ERROR: could not write '" << filename << "'\n";
+			return false;
+		}
+		out << "PF\n" << w << ' ' << h << "\n" << (host_little_endian() ? "-1.0" : "1.0") << "\n";
+		for (int y = h - 1; y >= 0; y--) {
+			out.write(reinterpret_cast<const char*>(&data[size_t(y) * w * 3]), std::streamsize(size_t(w) * 3 * sizeof(float)));
+		}
+		return bool(out);
+	}
+
+private:
+	int w = 0, h = 0;
+	std::vector<float> data;
+
+	/*PFM is about the simplest float format there is:
+	"PF" (rgb) or "Pf" (greyscale), then width height, then a scale whose sign gives the byte order
+	(negative = little endian), then raw floats with the BOTTOM row first.*/
+	bool load_pfm(const std::string& filename) {
+		std::ifstream in(filename, std::ios::binary);
+		if (!in) {
+			std::cerr << "ERROR: could not open '" << filename << "'\n";
+			return false;
+		}
+		std::string magic;
+		double scale;
+		in >> magic >> w >> h >> scale;
+		//exactly one whitespace character separates the header from the data
+		in.get();
+		if (!in || (magic != "PF" && magic != "Pf") || w <= 0 || h <= 0) {
+			std::cerr << "ERROR: '" << filename << "' is not a valid PFM file\n";
+			return false;
+		}
+		int channels = (magic == "PF") ? 3 : 1;
+		std::vector<float> raw(size_t(w) * h * channels);
+		in.read(reinterpret_cast<char*>(raw.data()), std::streamsize(raw.size() * sizeof(float)));
+		if (!in) {
+			std::cerr << "ERROR: '" << filename << "' is truncated\n";
+			return false;
+		}
+		bool file_little_endian = scale < 0;
+		if (file_little_endian != host_little_endian()) {
+			for (auto& f : raw) {
+				f = byte_swap(f);
+			}
+		}
+
+		data.resize(size_t(w) * h * 3);
+		for (int y = 0; y < h; y++) {
+			//flip so row 0 is the top of the image
+			const float* src = &raw[size_t(h - 1 - y) * w * channels];
+			float* dst = &data[size_t(y) * w * 3];
+			for (int x = 0; x < w; x++) {
+				for (int c = 0; c < 3; c++) {
+					dst[x * 3 + c] = src[x * channels + (channels == 3 ? c : 0)];
+				}
+			}
+		}
+		return true;
+	}
+
+	/*Radiance .hdr stores each pixel as RGBE: three 8 bit mantissas that share one 8 bit exponent.
+	The header is text lines ending in a blank line, then a resolution line like "-Y 512 +X 1024".
+	Scanlines are usually run length encoded one channel at a time ("new" RLE), otherwise they're flat.*/
+	bool load_hdr(const std::string& filename) {
+		std::ifstream in(filename, std::ios::binary);
+		if (!in) {
+			std::cerr << "ERROR: could not open '" << filename << "'\n";
+			return false;
+		}
+		std::string line;
+		std::getline(in, line);
+		if (line.compare(0, 2, "#?") != 0) {
+			std::cerr << "ERROR: '" << filename << "' is not a Radiance HDR file\n";
+			return false;
+		}
+		while (std::getline(in, line) && !line.empty()) {
+			if (line.compare(0, 7, "FORMAT=") == 0 && line != "FORMAT=32-bit_rle_rgbe") {
+				std::cerr << "ERROR: '" << filename << "' uses an unsupported pixel format (" << line << ")\n";
+				return false;
+			}
+		}
+		std::string y_axis, x_axis;
+		in >> y_axis >> h >> x_axis >> w;
+		in.get();
+		if (!in || y_axis != "-Y" || x_axis != "+X" || w <= 0 || h <= 0) {
+			std::cerr << "ERROR: '" << filename << "' has an unsupported resolution line, only -Y H +X W is handled\n";
+			return false;
+		}
+
+		data.resize(size_t(w) * h * 3);
+		std::vector<unsigned char> scanline(size_t(w) * 4);
+		for (int y = 0; y < h; y++) {
+			if (!read_hdr_scanline(in, scanline)) {
+				std::cerr << "ERROR: '" << filename << "' is truncated or corrupt\n";
+				return false;
+			}
+			float* dst = &data[size_t(y) * w * 3];
+			for (int x = 0; x < w; x++) {
+				rgbe_to_float(&scanline[size_t(x) * 4], &dst[x * 3]);
+			}
+		}
+		return true;
+	}
+
+	bool read_hdr_scanline(std::ifstream& in, std::vector<unsigned char>& scanline) {
+		unsigned char head[4];
+		if (!in.read(reinterpret_cast<char*>(head), 4)) {
+			return false;
+		}
+		bool rle = w >= 8 && w < 32768 && head[0] == 2 && head[1] == 2 && ((head[2] << 8) | head[3]) == w;
+		if (!rle) {
+			//flat scanline, we already read the first pixel
+			std::memcpy(scanline.data(), head, 4);
+			return bool(in.read(reinterpret_cast<char*>(scanline.data() + 4), std::streamsize(scanline.size() - 4)));
+		}
+		//each channel is stored separately as runs (count > 128) or literal spans
+		for (int c = 0; c < 4; c++) {
+			int x = 0;
+			while (x < w) {
+				int count = in.get();
+				if (count == EOF) {
+					return false;
+				}
+				if (count > 128) {
+					count -= 128;
+					int value = in.get();
+					if (value == EOF || x + count > w) {
+						return false;
+					}
+					for (int k = 0; k < count; k++) {
+						scanline[size_t(x++) * 4 + c] = (unsigned char)value;
+					}
+				}
+				else {
+					if (count == 0 || x + count > w) {
+						return false;
+					}
+					for (int k = 0; k < count; k++) {
+						int value = in.get();
+						if (value == EOF) {
+							return false;
+						}
+						scanline[size_t(x++) * 4 + c] = (unsigned char)value;
+					}
+				}
+			}
+		}
+		return true;
+	}
+
+	static void rgbe_to_float(const unsigned char* rgbe, float* rgb) {
+		if (rgbe[3] == 0) {
+			rgb[0] = rgb[1] = rgb[2] = 0;
+			return;
+		}
+		//the mantissas are fractions of 256, so the 8 is folded into the exponent
+		float f = float(std::ldexp(1.0, int(rgbe[3]) - (128 + 8)));
+		rgb[0] = (rgbe[0] + 0.5f) * f;
+		rgb[1] = (rgbe[1] + 0.5f) * f;
+		rgb[2] = (rgbe[2] + 0.5f) * f;
+	}
+
+	static bool host_little_endian() {
+		std::uint16_t one = 1;
+		unsigned char first;
+		std::memcpy(&first, &one, 1);
+		return first == 1;
+	}
+
+	static float byte_swap(float f) {
+		unsigned char b[4];
+		std::memcpy(b, &f, 4);
+		std::swap(b[0], b[3]);
+		std::swap(b[1], b[2]);
+		std::memcpy(&f, b, 4);
+		return f;
+	}
+};
+
+#endif
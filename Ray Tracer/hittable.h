@@ -3,16 +3,31 @@
 
 //Class for objects which can be hit by rays, not a table of hits!
 #include "consts_n_utils.h"
+
+#include <vector>
+
 //It's been a while since i've done something like this
 //putting a class like this just means we promise to define material later
 //this will keep us from getting a circular reference issue in material.h
 class material;
+class hittable;
+
+//one bit per material class (see material.h), so the camera can tell which ones a scene uses and specialize for them
+//materials defined anywhere else are custom_material and always go through the virtual calls
+enum material_kind : unsigned {
+	custom_material = 1,
+	lambertian_material = 2,
+	metal_material = 4,
+	dielectric_material = 8,
+	light_material = 16
+};
 
 class hit_record {
 public:
 	point3 p;
 	vec3 normal;
 	shared_ptr<material> mat;
+	const hittable* object = nullptr; //the object we hit, used to look up whether it's a light we can sample directly
 	double t;
 	//decision time, do we want normals to always point outwards or always point against the ray?
 	//if normals always point outwards, we can check if a ray is inside or outside the sphere by checking it's direction against the normals
@@ -38,5 +53,33 @@ public:
 	virtual ~hittable() = default;
 	//a hit is only valid if t is between tmin and tmax!
 	virtual bool hit(const ray& r, interval ray_t, hit_record& rec) const = 0;
+
+	//for objects we can sample directly as lights:
+	//pdf_value is the solid angle pdf of random() picking direction from origin
+	virtual double pdf_value(const point3& origin, const vec3& direction) const {
+		return 0.0;
+	}
+	//returns a random direction from origin towards this object
+	virtual vec3 random(const point3& origin) const {
+		return vec3(1, 0, 0);
+	}
+	//traces many rays at once: hits[i] says whether rays[i] hit something and recs[i] what.
+	//objects that can share work between rays (out of core scenes read each chunk once per batch) override it
+	virtual void hit_batch(const std::vector<ray>& rays, interval ray_t, std::vector<hit_record>& recs, std::vector<char>& hits) const {
+		recs.resize(rays.size());
+		hits.resize(rays.size());
+		for (size_t i = 0; i < rays.size(); i++) {
+			hits[i] = hit(rays[i], ray_t, recs[i]);
+		}
+	}
+	//true if hit_batch is much faster than calling hit for each ray, which makes the camera trace in wavefronts
+	virtual bool batched() const {
+		return false;
+	}
+	//material_kind bits of every material this object can hand out in a hit_record
+	//custom_material means "don't know", which keeps the camera on its generic path
+	virtual unsigned material_kinds() const {
+		return custom_material;
+	}
 };
 #endif
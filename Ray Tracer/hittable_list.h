@@ -40,6 +40,40 @@ public:
 		}
 		return hit_anything;
 	}
+
+	//each object traces the whole batch, and the closest hit of each ray wins
+	void hit_batch(const std::vector<ray>& rays, interval ray_t, std::vector<hit_record>& recs, std::vector<char>& hits) const override {
+		recs.resize(rays.size());
+		hits.assign(rays.size(), 0);
+		std::vector<hit_record> object_recs;
+		std::vector<char> object_hits;
+		for (const auto& object : objects) {
+			object->hit_batch(rays, ray_t, object_recs, object_hits);
+			for (size_t i = 0; i < rays.size(); i++) {
+				if (object_hits[i] && (!hits[i] || object_recs[i].t < recs[i].t)) {
+					hits[i] = 1;
+					recs[i] = object_recs[i];
+				}
+			}
+		}
+	}
+
+	bool batched() const override {
+		for (const auto& object : objects) {
+			if (object->batched()) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	unsigned material_kinds() const override {
+		unsigned kinds = 0;
+		for (const auto& object : objects) {
+			kinds |= object->material_kinds();
+		}
+		return kinds;
+	}
 };
 
 #endif
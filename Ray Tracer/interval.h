@@ -9,6 +9,8 @@ public:
 	interval() : min(+infinity), max(-infinity) {} // treat default interval as empty
 
 	interval(double min, double max) : min(min), max(max) {}
+	//the tightest interval enclosing both a and b
+	interval(const interval& a, const interval& b) : min(a.min <= b.min ? a.min : b.min), max(a.max >= b.max ? a.max : b.max) {}
 	//returns the length of the interval
 	double size() const {
 		return max - min;
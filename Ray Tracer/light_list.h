@@ -0,0 +1,85 @@
+#ifndef LIGHT_LIST_H
+#define LIGHT_LIST_H
+//the set of emitters we sample directly (next event estimation)
+//lights still need to be added to the world as well, this list is only used to aim rays at them
+#include "hittable.h"
+#include "alias_table.h"
+
+#include <atomic>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+class light_list {
+public:
+	std::vector<shared_ptr<hittable>> objects;
+
+	light_list() {}
+	light_list(const light_list& other) : objects(other.objects), powers(other.powers), index(other.index) {}
+	light_list& operator=(const light_list& other) {
+		objects = other.objects;
+		powers = other.powers;
+		index = other.index;
+		built = false;
+		return *this;
+	}
+
+	//power is how often the light gets picked relative to the others,
+	//something like emitted luminance * surface area works well
+	void add(shared_ptr<hittable> object, double power = 1.0) {
+		index[object.get()] = int(objects.size());
+		objects.push_back(object);
+		powers.push_back(power);
+		//the alias table is rebuilt once, the next time it's needed, not once per light
+		built = false;
+	}
+
+	//builds the alias table now instead of on the first sample, e.g. so it isn't timed as part of a render
+	void finalize() const {
+		if (!built.load(std::memory_order_acquire)) {
+			std::lock_guard<std::mutex> lock(build_mutex);
+			if (!built.load(std::memory_order_relaxed)) {
+				table = alias_table(powers);
+				built.store(true, std::memory_order_release);
+			}
+		}
+	}
+
+	bool empty() const { return objects.empty(); }
+
+	//picks a light and a direction from origin towards it
+	//pdf is in solid angle and already includes the chance of picking that light
+	//returns false if the chosen light can't be sampled from here (e.g. we're inside it)
+	bool sample(const point3& origin, vec3& direction, double& pdf, const hittable*& light) const {
+		if (empty()) {
+			return false;
+		}
+		finalize();
+		int i = table.sample(random_double());
+		light = objects[i].get();
+		direction = light->random(origin);
+		pdf = table.pmf(i) * light->pdf_value(origin, direction);
+		return pdf > 0;
+	}
+
+	//pdf of sample() producing a ray from origin along direction that lands on object
+	//objects that aren't in the list can never be sampled, so their pdf is 0
+	double pdf_value(const hittable* object, const point3& origin, const vec3& direction) const {
+		auto it = index.find(object);
+		if (it == index.end()) {
+			return 0;
+		}
+		finalize();
+		return table.pmf(it->second) * object->pdf_value(origin, direction);
+	}
+
+private:
+	std::vector<double> powers;
+	//built lazily by finalize, which render threads may call at the same time
+	mutable alias_table table;
+	mutable std::atomic<bool> built{ false };
+	mutable std::mutex build_mutex;
+	std::unordered_map<const hittable*, int> index; //lets an emissive hit find its own light without a linear search
+};
+
+#endif
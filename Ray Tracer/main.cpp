@@ -5,65 +5,82 @@
 #include "hittable_list.h"
 #include "material.h"
 #include "sphere.h"
+#include "out_of_core_scene.h"
+#include "scenes.h"
+#include "render_server.h"
+#include "benchmarks.h"
 
+#include <cstdlib>
+#include <string>
 
-int main() {
 
-
-	//World
-	hittable_list world;
-	//grey colored ground
-	auto ground_material = make_shared<lambertian>(color(0.5, 0.5, 0.5));
-	//sphere representing the ground
-	world.add(make_shared<sphere>(point3(0, -1000, 0), 1000, ground_material));
-
-	//For loop to populate world with spheres
-	for (int a = -11; a < 11; a++) {
-		for (int b = -11; b < 11; b++) {
-			//generate a random double to pick which material to use
-			auto choose_mat = random_double();
-			//place the sphere within a certain radius of a and b iteration
-			point3 center(a + 0.9 * random_double(), 0.2, b + 0.9 * random_double());
-			if ((center - point3(4, 0.2, 0)).length() > 0.9) {
-				shared_ptr<material> sphere_material;
-				if (choose_mat < 0.8) {
-					//create diffuse material, approx 80% of spheres will be lambertian
-					//randomly generate sphere color
-					auto albedo = color::random() * color::random();
-					sphere_material = make_shared<lambertian>(albedo);
-					world.add(make_shared<sphere>(center, 0.2, sphere_material));
-				}
-				else if (choose_mat < 0.95) {
-					//create metal material, approx 15% of our spheres will be metal
-					//randomly generate our metal's color and fuzziness
-					auto albedo = color::random(0.5, 1);
-					auto fuzz = random_double(0, 0.5);
-					sphere_material = make_shared<metal>(albedo, fuzz);
-					world.add(make_shared<sphere>(center, 0.2, sphere_material));
-				}
-				else {
-					//finally make a glass material, approximately 5% of the spheres will be glass
-					sphere_material = make_shared<dielectric>(1.5);
-					world.add(make_shared<sphere>(center, 0.2, sphere_material));
-				}
-			}
+int main(int argc, char* argv[]) {
+	//benchmarks print a report instead of an image
+	std::string mode = (argc > 1) ? argv[1] : "";
+	if (mode == "--bench-nee") {
+		return bench_nee();
+	}
+	//exits with 1 if light sampling and plain path tracing disagree on rough metal
+	if (mode == "--check-nee") {
+		return check_rough_metal_nee();
+	}
+	if (mode == "--bench-env") {
+		return bench_env(argc > 2 ? argv[2] : "");
+	}
+	if (mode == "--bench-denoise") {
+		return bench_denoise();
+	}
+	if (mode == "--bench-preview") {
+		return bench_preview();
+	}
+	//samples/s of each compile time specialization of the per-sample path against the generic one
+	if (mode == "--bench-kernels") {
+		return bench_kernels();
+	}
+	//writes a synthetic scene file and traces it with the chunk cache at several sizes: --bench-ooc [millions of spheres] [file]
+	if (mode == "--bench-ooc") {
+		return bench_out_of_core(argc > 2 ? std::atof(argv[2]) : 2, argc > 3 ? argv[3] : "");
+	}
+	//a job mix through the render server against one process per job, self is needed to start those processes
+	if (mode == "--bench-server") {
+		return bench_server(argv[0]);
+	}
+	//long running render service: --serve <socket> [threads], then --submit <socket> scene=... width=... etc.
+	if (mode == "--serve" && argc > 2) {
+		render_server server(argc > 3 ? std::atoi(argv[3]) : 0);
+		if (!server.listen(argv[2])) {
+			return 1;
 		}
+		std::clog << "Serving on " << argv[2] << " with " << server.threads() << " threads\n";
+		server.serve();
+		return 0;
+	}
+	if ((mode == "--submit" && argc > 2) || mode == "--job") {
+		//the rest of the arguments are the request, "stats" and "shutdown" work for --submit too
+		std::string request;
+		for (int a = (mode == "--job") ? 2 : 3; a < argc; a++) {
+			request += std::string(argv[a]) + ' ';
+		}
+		if (mode == "--job") {
+			return run_single_job(request);
+		}
+		std::string reply;
+		if (!send_request(argv[2], request.substr(0, request.size() - 1), reply)) {
+			return 1;
+		}
+		std::cout << reply << "\n";
+		return reply.compare(0, 2, "ok") == 0 ? 0 : 1;
+	}
+	//grabs the latest pass of a running --preview render and writes it out as a ppm
+	if (mode == "--dump-preview" && argc > 2) {
+		return dump_preview(argv[2]);
 	}
 
-	//make 3 bigger spheres to show off each type of material
-	auto material1 = make_shared<dielectric>(1.5);
-	world.add(make_shared<sphere>(point3(0, 1, 0), 1.0, material1));
-
-	auto material2 = make_shared<lambertian>(color(0.4, 0.2, 0.1));
-	world.add(make_shared<sphere>(point3(-4, 1, 0), 1.0, material2));
-
-	auto material3 = make_shared<metal>(color(0.7, 0.6, 0.5), 0.0);
-	world.add(make_shared<sphere>(point3(4, 1, 0), 1.0, material3));
-
-	//camera
+	//World
+	hittable_list world;
 	camera cam;
-	//set our ratio and image width
-	cam.aspect_ratio = 16.0 / 9.0;
+	book_scene(world, cam);
+	//set our image width
 	cam.image_width = 3840;
 	//antialiasing effect with random point selection in a square.
 	cam.samples_per_pixel = 10;
@@ -71,14 +88,30 @@ int main() {
 	//set maximum recursion for ray_color
 	cam.max_depth = 50;
 
-	//set camera position and angle
-	cam.vfov = 20;
-	cam.lookfrom = point3(13, 2, 3);
-	cam.lookat = point3(0, 0, 0);
-	cam.vup = vec3(0, 1, 0);
-
-	cam.defocus_angle = 0.6;
-	cam.focus_dist = 10.0;
+	//options that take a value: --env <file.hdr>, --preview <name> and --scene <file.bin>
+	for (int a = 1; a + 1 < argc; a += 2) {
+		std::string option = argv[a];
+		if (option == "--env") {
+			//light the scene with an HDR environment map instead of the sky gradient
+			cam.environment = make_shared<environment_light>();
+			if (!cam.environment->load(argv[a + 1])) {
+				return 1;
+			}
+		}
+		else if (option == "--preview") {
+			//render in passes and publish each one to shared memory, look at it with --dump-preview <name>
+			cam.preview_name = argv[a + 1];
+		}
+		else if (option == "--scene") {
+			//render a scene file instead of the random spheres, chunks of it are streamed in as rays reach them
+			auto scene = make_shared<out_of_core_scene>();
+			if (!scene->open(argv[a + 1])) {
+				return 1;
+			}
+			world.clear();
+			world.add(scene);
+		}
+	}
 
 	cam.render(world);
 
@@ -1,56 +1,219 @@
 #ifndef MATERIAL_H
 #define MATERIAL_H
 #include "hittable.h"
+#include "onb.h"
+
+//everything a material reports about one sampled bounce
+class scatter_record {
+public:
+	ray scattered; //the sampled outgoing ray
+	color bsdf_cos; //bsdf value times cos(theta) for the sampled direction (unused for specular bounces)
+	double pdf = 0; //solid angle pdf of sampling that direction, 0 for perfectly specular bounces
+	color attenuation; //bsdf_cos / pdf, what the bounce multiplies incoming light by. for specular bounces it's just the reflectance
+};
 
 class material {
 public:
+	material(unsigned kind = custom_material) : kind_flag(kind) {}
 	virtual ~material() = default;
-	//returns a bool because not all materials scatter
-	virtual bool scatter(
-		const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered
-	) const {
+	//which class this is, without a virtual call
+	unsigned kind() const { return kind_flag; }
+	//samples a bounce, returns a bool because not all materials scatter
+	virtual bool scatter(const ray& r_in, const hit_record& rec, scatter_record& srec) const {
 		return false;
 	}
+	//light given off by the surface itself, most materials don't emit anything
+	virtual color emitted(const ray& r_in, const hit_record& rec) const {
+		return color(0, 0, 0);
+	}
+	//surface color for the denoiser's albedo buffer
+	virtual color base_color(const hit_record& rec) const {
+		return color(1, 1, 1);
+	}
+	//bsdf * cos(theta) for a direction we picked ourselves (e.g. towards a light)
+	virtual color eval(const ray& r_in, const hit_record& rec, const ray& scattered) const {
+		return color(0, 0, 0);
+	}
+	//pdf (in solid angle) of scatter() picking the scattered direction
+	//0 means the material is perfectly specular (a delta), which we can't combine with light sampling
+	virtual double scattering_pdf(const ray& r_in, const hit_record& rec, const ray& scattered) const {
+		return 0;
+	}
+	//true when the bsdf is a delta (or there is none), so aiming shadow rays at lights can never find anything.
+	//decided by the material alone, not by whether one scatter() call happened to succeed
+	//a material whose scatter() reports a pdf > 0 has to return false, MIS counts on the light sample being taken
+	virtual bool is_specular() const {
+		return true;
+	}
+private:
+	unsigned kind_flag;
 };
 //Add a class for materials which perform lambertian reflection
-class lambertian : public material {
+class lambertian final : public material {
 public:
 	//albedo in this case just means fractional reflectance
-	lambertian(const color& albedo) : albedo(albedo) {}
-
-	bool scatter(const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered) const override {
-		auto scatter_direction = rec.normal + random_unit_vector();
-		if (scatter_direction.near_zero()) {
-			//if the random vector we generate is almost the same as the normal but negative
-			//we will get a 0 scatter direction vector, which later on will be really really bad
-			//so we'll handle it now.
-			scatter_direction = rec.normal;
-		}
-		scattered = ray(rec.p, scatter_direction);
-		attenuation = albedo;
+	lambertian(const color& albedo) : material(lambertian_material), albedo(albedo) {}
+
+	bool scatter(const ray& r_in, const hit_record& rec, scatter_record& srec) const override {
+		//sample proportional to cos(theta) directly, no rejection loop and never a zero direction
+		onb uvw(rec.normal);
+		auto scatter_direction = uvw.transform(random_cosine_direction());
+		srec.scattered = ray(rec.p, scatter_direction);
+		srec.pdf = dot(uvw.w(), scatter_direction) / pi;
+		srec.bsdf_cos = albedo * srec.pdf;
+		//(albedo / pi) * cos / (cos / pi), everything but the albedo cancels
+		srec.attenuation = albedo;
 		return true;
 	}
+	color base_color(const hit_record& rec) const override {
+		return albedo;
+	}
+	color eval(const ray& r_in, const hit_record& rec, const ray& scattered) const override {
+		return albedo * scattering_pdf(r_in, rec, scattered);
+	}
+	double scattering_pdf(const ray& r_in, const hit_record& rec, const ray& scattered) const override {
+		auto cos_theta = dot(rec.normal, unit_vector(scattered.direction()));
+		return cos_theta < 0 ? 0 : cos_theta / pi;
+	}
+	bool is_specular() const override {
+		return false;
+	}
 
 private:
 	color albedo;
 };
 
-class metal : public material {
+/*metal uses the GGX (Trowbridge-Reitz) microfacet model: the surface is made of tiny perfect mirrors
+whose normals are spread out according to roughness. We sample only the microfacet normals
+the incoming ray can actually see (Heitz 2018, "Sampling the GGX Distribution of Visible Normals"),
+so nearly every sample reflects above the surface instead of being thrown away.
+All the math happens in a local frame where the shading normal is +z.*/
+class metal final : public material {
 public:
-	//fuzz will define the radius of a sphere which we will choose a point on to randomize the reflected direction
-	//this gives us a "fuzzy" effect
-	metal(const color& albedo, double fuzz) : albedo(albedo), fuzz(fuzz < 1 ? fuzz : 1) {}
+	//roughness 0 is a perfect mirror, 1 is very rough. albedo is the reflectance looking straight on
+	metal(const color& albedo, double roughness) : material(metal_material), albedo(albedo) {
+		roughness = std::fmin(std::fmax(roughness, 0.0), 1.0);
+		//squaring roughness makes the slider feel more even
+		alpha = roughness * roughness;
+	}
 
-	bool scatter(const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered) const override {
-		vec3 reflected = reflect(r_in.direction(), rec.normal);
-		reflected = unit_vector(reflected) + (fuzz * random_unit_vector());
-		scattered = ray(rec.p, reflected);
-		attenuation = albedo;
-		return (dot(scattered.direction(), rec.normal) > 0);
+	bool scatter(const ray& r_in, const hit_record& rec, scatter_record& srec) const override {
+		onb uvw(rec.normal);
+		vec3 wo = uvw.to_local(-unit_vector(r_in.direction()));
+		if (wo.z() <= 0) {
+			return false;
+		}
+		if (is_mirror()) {
+			vec3 wi(-wo.x(), -wo.y(), wo.z());
+			srec.scattered = ray(rec.p, uvw.transform(wi));
+			srec.pdf = 0;
+			srec.attenuation = fresnel(wo.z());
+			return true;
+		}
+		vec3 m = sample_visible_normal(wo);
+		vec3 wi = reflect(-wo, m);
+		if (wi.z() <= 0) {
+			//reflected into the surface, single scattering GGX just loses this energy
+			return false;
+		}
+		srec.scattered = ray(rec.p, uvw.transform(wi));
+		srec.pdf = pdf_local(wo, m);
+		srec.bsdf_cos = bsdf_cos_local(wo, wi, m);
+		//D and the visible normal terms cancel out, leaving F * G2 / G1
+		srec.attenuation = fresnel(dot(wi, m)) * (g1(wo) == 0 ? 0 : g2(wo, wi) / g1(wo));
+		return true;
+	}
+	color base_color(const hit_record& rec) const override {
+		return albedo;
+	}
+	color eval(const ray& r_in, const hit_record& rec, const ray& scattered) const override {
+		if (is_mirror()) {
+			return color(0, 0, 0);
+		}
+		onb uvw(rec.normal);
+		vec3 wo = uvw.to_local(-unit_vector(r_in.direction()));
+		vec3 wi = uvw.to_local(unit_vector(scattered.direction()));
+		if (wo.z() <= 0 || wi.z() <= 0) {
+			return color(0, 0, 0);
+		}
+		return bsdf_cos_local(wo, wi, unit_vector(wo + wi));
+	}
+	double scattering_pdf(const ray& r_in, const hit_record& rec, const ray& scattered) const override {
+		if (is_mirror()) {
+			return 0;
+		}
+		onb uvw(rec.normal);
+		vec3 wo = uvw.to_local(-unit_vector(r_in.direction()));
+		vec3 wi = uvw.to_local(unit_vector(scattered.direction()));
+		if (wo.z() <= 0 || wi.z() <= 0) {
+			return 0;
+		}
+		return pdf_local(wo, unit_vector(wo + wi));
+	}
+	bool is_specular() const override {
+		return is_mirror();
 	}
 private:
 	color albedo;
-	double fuzz;
+	double alpha; //GGX width, roughness squared
+
+	//below this the lobe is so narrow we treat it as a perfect mirror (and skip light sampling)
+	bool is_mirror() const { return alpha < 1e-4; }
+
+	//schlick's approximation again, with the albedo as the reflectance at normal incidence
+	color fresnel(double cosine) const {
+		auto c = std::pow(1 - std::fmax(cosine, 0.0), 5);
+		return albedo + c * (color(1, 1, 1) - albedo);
+	}
+	//GGX normal distribution, how many microfacets face along m
+	double d(const vec3& m) const {
+		if (m.z() <= 0) {
+			return 0;
+		}
+		auto a2 = alpha * alpha;
+		auto t = m.z() * m.z() * (a2 - 1) + 1;
+		return a2 / (pi * t * t);
+	}
+	//smith lambda, how much of the surface is shadowed looking along w
+	double lambda(const vec3& w) const {
+		auto cos2 = w.z() * w.z();
+		if (cos2 <= 0) {
+			return infinity;
+		}
+		auto tan2 = (1 - cos2) / cos2;
+		return (-1 + std::sqrt(1 + alpha * alpha * tan2)) / 2;
+	}
+	double g1(const vec3& w) const { return 1 / (1 + lambda(w)); }
+	double g2(const vec3& wo, const vec3& wi) const { return 1 / (1 + lambda(wo) + lambda(wi)); }
+
+	//pdf of the reflected direction when m came from sample_visible_normal
+	double pdf_local(const vec3& wo, const vec3& m) const {
+		return g1(wo) * d(m) / (4 * wo.z());
+	}
+	//F * D * G2 / (4 cos_o cos_i) * cos_i
+	color bsdf_cos_local(const vec3& wo, const vec3& wi, const vec3& m) const {
+		return (d(m) * g2(wo, wi) / (4 * wo.z())) * fresnel(dot(wi, m));
+	}
+
+	//picks a microfacet normal visible from wo, proportional to how much of it wo sees
+	vec3 sample_visible_normal(const vec3& wo) const {
+		//stretch the view so the GGX lobe becomes a hemisphere
+		vec3 vh = unit_vector(vec3(alpha * wo.x(), alpha * wo.y(), wo.z()));
+		//build a basis around the stretched view
+		auto lensq = vh.x() * vh.x() + vh.y() * vh.y();
+		vec3 t1 = lensq > 0 ? vec3(-vh.y(), vh.x(), 0) / std::sqrt(lensq) : vec3(1, 0, 0);
+		vec3 t2 = cross(vh, t1);
+		//pick a point on the projected disk, squashed to the part of it that's visible
+		auto r = std::sqrt(random_double());
+		auto phi = 2 * pi * random_double();
+		auto p1 = r * std::cos(phi);
+		auto p2 = r * std::sin(phi);
+		auto s = 0.5 * (1 + vh.z());
+		p2 = (1 - s) * std::sqrt(1 - p1 * p1) + s * p2;
+		//project back up onto the hemisphere, then unstretch
+		vec3 nh = p1 * t1 + p2 * t2 + std::sqrt(std::fmax(0.0, 1 - p1 * p1 - p2 * p2)) * vh;
+		return unit_vector(vec3(alpha * nh.x(), alpha * nh.y(), std::fmax(0.0, nh.z())));
+	}
 };
 
 /*Some helpful definitions for defining materials
@@ -68,13 +231,15 @@ the boundary acts like a mirror*/
 
 
 
-class dielectric : public material {
+class dielectric final : public material {
 public:
-	dielectric(double refraction_index) : refraction_index(refraction_index) {}
+	dielectric(double refraction_index) : material(dielectric_material), refraction_index(refraction_index) {}
 
-	bool scatter(const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered) const override {
+	bool scatter(const ray& r_in, const hit_record& rec, scatter_record& srec) const override {
 		//for glass it absorbs nothing, so attenuation is always 1
-		attenuation = color(1.0, 1.0, 1.0);
+		srec.attenuation = color(1.0, 1.0, 1.0);
+		//glass is perfectly specular
+		srec.pdf = 0;
 		double ri = rec.front_face ? (1.0 / refraction_index) : refraction_index;
 
 		vec3 unit_direction = unit_vector(r_in.direction());
@@ -91,7 +256,7 @@ public:
 			direction = refract(unit_direction, rec.normal, ri);
 		}
 
-		scattered = ray(rec.p, direction);
+		srec.scattered = ray(rec.p, direction);
 		return true;
 	}
 private:
@@ -108,4 +273,40 @@ private:
 	}
 };
 
+//material for light sources, it doesn't scatter, it just gives off light
+class diffuse_light final : public material {
+public:
+	diffuse_light(const color& emit) : material(light_material), emit(emit) {}
+
+	color emitted(const ray& r_in, const hit_record& rec) const override {
+		//only the outside of the surface glows
+		if (!rec.front_face) {
+			return color(0, 0, 0);
+		}
+		return emit;
+	}
+private:
+	color emit;
+};
+
+/*calls f with m cast to its concrete class when that class is in Materials (a mask of material_kind bits),
+otherwise with m itself. the concrete classes are final, so calls through the cast skip the vtable and can be inlined.
+Materials = 0 is the plain virtual path*/
+template <unsigned Materials, typename F>
+auto visit_material(const material& m, F&& f) -> decltype(f(m)) {
+	if ((Materials & lambertian_material) && m.kind() == lambertian_material) {
+		return f(static_cast<const lambertian&>(m));
+	}
+	if ((Materials & metal_material) && m.kind() == metal_material) {
+		return f(static_cast<const metal&>(m));
+	}
+	if ((Materials & dielectric_material) && m.kind() == dielectric_material) {
+		return f(static_cast<const dielectric&>(m));
+	}
+	if ((Materials & light_material) && m.kind() == light_material) {
+		return f(static_cast<const diffuse_light&>(m));
+	}
+	return f(m);
+}
+
 #endif // !MATERIAL_H
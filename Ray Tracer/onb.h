@@ -0,0 +1,35 @@
+#ifndef ONB_H
+#define ONB_H
+//orthonormal basis, lets us build a direction in a local frame (z = some normal or axis)
+//and then rotate it into world space
+#include "consts_n_utils.h"
+
+class onb {
+public:
+	//builds a basis whose w (z) axis points along n
+	onb(const vec3& n) {
+		axis[2] = unit_vector(n);
+		//pick any vector that isn't (nearly) parallel to n to cross against
+		vec3 a = (std::fabs(axis[2].x()) > 0.9) ? vec3(0, 1, 0) : vec3(1, 0, 0);
+		axis[1] = unit_vector(cross(axis[2], a));
+		axis[0] = cross(axis[2], axis[1]);
+	}
+
+	const vec3& u() const { return axis[0]; }
+	const vec3& v() const { return axis[1]; }
+	const vec3& w() const { return axis[2]; }
+
+	//transform from basis coordinates to local (world) space
+	vec3 transform(const vec3& v) const {
+		return (v[0] * axis[0]) + (v[1] * axis[1]) + (v[2] * axis[2]);
+	}
+	//the other way around, world space into basis coordinates
+	vec3 to_local(const vec3& v) const {
+		return vec3(dot(v, axis[0]), dot(v, axis[1]), dot(v, axis[2]));
+	}
+
+private:
+	vec3 axis[3];
+};
+
+#endif
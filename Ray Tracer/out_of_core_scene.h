@@ -0,0 +1,637 @@
+#ifndef OUT_OF_CORE_SCENE_H
+#define OUT_OF_CORE_SCENE_H
+/*A hittable backed by a scene file (see scene_file.h) that can be much bigger than memory.
+
+The file is memory mapped, but only the chunk table and a small BVH over the chunk bounds stay resident.
+A chunk is copied out of the mapping the first time a ray needs it and checked before anything traces it;
+once the resident chunks add up to more than memory_budget bytes the least recently used ones are dropped.
+On POSIX we also tell the OS it can drop the mapped pages we copied from, so the copy is the only one we keep.
+Finding a resident chunk takes no lock, a chunk being paged in is marked loading so other threads wait for
+that one chunk only, and the lock around the eviction bookkeeping is never held while copying from the file.
+
+hit() works one ray at a time and pages chunks in as it goes, which is fine when the working set fits the budget.
+hit_batch() queues every ray against every chunk it might touch, traces the chunks that are already resident,
+then pages in the rest one at a time and traces all of their queued rays together,
+so each chunk is read at most once per batch no matter how small the budget is.
+The camera sends its rays through hit_batch a wavefront at a time when the world is batched().*/
+#include "hittable.h"
+#include "scene_file.h"
+#include "sphere.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <condition_variable>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+class out_of_core_scene : public hittable {
+public:
+	out_of_core_scene(size_t memory_budget = size_t(256) << 20) : memory_budget(memory_budget) {}
+	~out_of_core_scene() { close(); }
+	out_of_core_scene(const out_of_core_scene&) = delete;
+	out_of_core_scene& operator=(const out_of_core_scene&) = delete;
+
+	//maps the file and reads its chunk table, prints an error and returns false on failure
+	bool open(const std::string& path) {
+		close();
+		if (!map_file(path)) {
+			return false;
+		}
+		if (file_bytes < sizeof(scene_file_header)) {
+			return fail(path);
+		}
+		scene_file_header header;
+		std::memcpy(&header, file_data, sizeof(header));
+		//sizes are compared by division so a corrupt count can't overflow past the checks
+		if (std::memcmp(header.magic, scene_file_magic(), sizeof(header.magic)) != 0 || header.version != 1
+			|| header.material_count == 0
+			|| header.material_count > (file_bytes - sizeof(header)) / sizeof(scene_material)
+			|| header.chunk_table_offset > file_bytes
+			|| header.chunk_count > (file_bytes - header.chunk_table_offset) / sizeof(chunk_entry)) {
+			return fail(path);
+		}
+
+		materials.clear();
+		for (std::uint32_t m = 0; m < header.material_count; m++) {
+			scene_material desc;
+			std::memcpy(&desc, file_data + sizeof(header) + m * sizeof(scene_material), sizeof(desc));
+			materials.push_back(desc.make());
+		}
+		chunks.resize(size_t(header.chunk_count));
+		std::memcpy(chunks.data(), file_data + header.chunk_table_offset, chunks.size() * sizeof(chunk_entry));
+		for (const auto& entry : chunks) {
+			if (!chunk_sizes_valid(entry)) {
+				return fail(path);
+			}
+		}
+		sphere_count = header.sphere_count;
+		slots.reset(new chunk_slot[chunks.size()]);
+
+		//small BVH over the chunk bounds, so a ray only looks at the chunks it passes through
+		std::vector<aabb> boxes(chunks.size());
+		for (size_t c = 0; c < chunks.size(); c++) {
+			boxes[c] = aabb(point3(chunks[c].bounds_min[0], chunks[c].bounds_min[1], chunks[c].bounds_min[2]),
+				point3(chunks[c].bounds_max[0], chunks[c].bounds_max[1], chunks[c].bounds_max[2]));
+		}
+		packed_bvh_builder(boxes, 1).build(chunk_order, top_nodes);
+		return true;
+	}
+
+	//not while anything is tracing rays against the scene
+	void close() {
+		clear_cache();
+		chunks.clear();
+		slots.reset();
+		top_nodes.clear();
+		chunk_order.clear();
+		unmap_file();
+	}
+
+	//bytes of chunk data allowed to stay resident, the most recently used chunk is always kept even if it's bigger
+	void set_memory_budget(size_t bytes) {
+		std::lock_guard<std::mutex> lock(cache_mutex);
+		memory_budget = bytes;
+		evict_to_budget(std::uint32_t(-1));
+	}
+
+	//drops every resident chunk, not while anything is tracing rays against the scene
+	void clear_cache() {
+		std::lock_guard<std::mutex> lock(cache_mutex);
+		for (auto c : resident_chunks) {
+			std::atomic_store(&slots[c].data, shared_ptr<const resident_chunk>());
+			slots[c].state = absent;
+		}
+		resident_chunks.clear();
+		resident_bytes = 0;
+	}
+
+	size_t chunk_count() const { return chunks.size(); }
+	std::uint64_t spheres() const { return sphere_count; }
+	size_t file_size() const { return file_bytes; }
+	size_t resident() const { return resident_bytes; }
+
+	//bounds of everything in the file, empty before open
+	aabb bounding_box() const {
+		if (top_nodes.empty()) {
+			return aabb();
+		}
+		const packed_node& root = top_nodes[0];
+		return aabb(point3(root.bounds_min[0], root.bounds_min[1], root.bounds_min[2]),
+			point3(root.bounds_max[0], root.bounds_max[1], root.bounds_max[2]));
+	}
+
+	//chunks copied in from the file since open, their total size, and how many were dropped again
+	std::uint64_t chunk_loads() const { return loads; }
+	std::uint64_t bytes_loaded() const { return loaded_bytes; }
+	std::uint64_t evictions() const { return evicted; }
+
+	unsigned material_kinds() const override {
+		unsigned kinds = 0;
+		for (const auto& mat : materials) {
+			kinds |= mat->kind();
+		}
+		return kinds;
+	}
+
+	bool batched() const override {
+		return true;
+	}
+
+	bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
+		ray_inverse inv(r);
+		auto closest = ray_t.max;
+		bool hit_anything = false;
+		std::uint32_t stack[max_stack_depth];
+		int top = 0;
+		if (!top_nodes.empty()) {
+			stack[top++] = 0;
+		}
+		while (top > 0) {
+			auto index = stack[--top];
+			const packed_node& node = top_nodes[index];
+			if (!hit_node(node, r, inv, interval(ray_t.min, closest))) {
+				continue;
+			}
+			if (node.count == 0) {
+				push_children(stack, top, index, node, r);
+				continue;
+			}
+			for (std::uint32_t k = node.offset; k < node.offset + node.count; k++) {
+				auto chunk = acquire(chunk_order[k]);
+				if (chunk && hit_chunk(*chunk, r, inv, interval(ray_t.min, closest), rec)) {
+					hit_anything = true;
+					closest = rec.t;
+				}
+			}
+		}
+		return hit_anything;
+	}
+
+	//traces a whole batch of rays, reordering the work by chunk. hits[i] says whether rays[i] hit, and recs[i] what it hit
+	void hit_batch(const std::vector<ray>& rays, interval ray_t, std::vector<hit_record>& recs, std::vector<char>& hits) const override {
+		size_t n = rays.size();
+		recs.resize(n);
+		hits.assign(n, 0);
+		std::vector<double> closest(n, ray_t.max);
+
+		//queue (chunk, ray) for every chunk box each ray passes through, with where the ray enters it
+		std::vector<batch_entry> queue;
+		std::uint32_t stack[max_stack_depth];
+		for (size_t i = 0; i < n; i++) {
+			ray_inverse inv(rays[i]);
+			int top = 0;
+			if (!top_nodes.empty()) {
+				stack[top++] = 0;
+			}
+			while (top > 0) {
+				auto index = stack[--top];
+				const packed_node& node = top_nodes[index];
+				double t_enter;
+				if (!hit_node(node, rays[i], inv, ray_t, t_enter)) {
+					continue;
+				}
+				if (node.count == 0) {
+					push_children(stack, top, index, node, rays[i]);
+					continue;
+				}
+				for (std::uint32_t k = node.offset; k < node.offset + node.count; k++) {
+					auto chunk = chunk_order[k];
+					if (hit_node(chunks[chunk], rays[i], inv, ray_t, t_enter)) {
+						queue.push_back({ chunk, std::uint32_t(i), t_enter });
+					}
+				}
+			}
+		}
+		std::sort(queue.begin(), queue.end(), [](const batch_entry& a, const batch_entry& b) {
+			return a.chunk < b.chunk || (a.chunk == b.chunk && a.ray < b.ray);
+		});
+
+		//one run per chunk. resident chunks go first so they're used before anything gets evicted, and within that
+		//nearer chunks (on average over their rays) before farther ones: once a ray has hit something, chunks
+		//behind the hit are skipped for it, and a chunk left with no rays isn't read at all
+		struct chunk_run {
+			size_t begin, end;
+			bool resident;
+			double mean_t;
+		};
+		std::vector<chunk_run> runs;
+		for (size_t begin = 0; begin < queue.size();) {
+			size_t end = begin;
+			double t_sum = 0;
+			while (end < queue.size() && queue[end].chunk == queue[begin].chunk) {
+				t_sum += queue[end].t_enter;
+				end++;
+			}
+			runs.push_back({ begin, end, slots[queue[begin].chunk].state == resident_state, t_sum / (end - begin) });
+			begin = end;
+		}
+		std::sort(runs.begin(), runs.end(), [](const chunk_run& a, const chunk_run& b) {
+			return a.resident != b.resident ? a.resident : a.mean_t < b.mean_t;
+		});
+
+		for (const auto& run : runs) {
+			bool needed = false;
+			for (size_t q = run.begin; q < run.end && !needed; q++) {
+				needed = queue[q].t_enter < closest[queue[q].ray];
+			}
+			if (!needed) {
+				continue;
+			}
+			auto chunk = acquire(queue[run.begin].chunk);
+			if (!chunk) {
+				continue;
+			}
+			for (size_t q = run.begin; q < run.end; q++) {
+				auto i = queue[q].ray;
+				if (queue[q].t_enter >= closest[i]) {
+					continue;
+				}
+				ray_inverse inv(rays[i]);
+				if (hit_chunk(*chunk, rays[i], inv, interval(ray_t.min, closest[i]), recs[i])) {
+					hits[i] = 1;
+					closest[i] = recs[i].t;
+				}
+			}
+		}
+	}
+
+private:
+	struct resident_chunk {
+		std::vector<packed_node> nodes;
+		std::vector<packed_sphere> spheres;
+		size_t bytes = 0;
+	};
+
+	//a chunk is absent, being copied in by one thread, resident, or broken (failed its checks, traced as empty)
+	enum chunk_state : int { absent, loading, resident_state, broken };
+	struct chunk_slot {
+		std::atomic<int> state{ absent };
+		shared_ptr<const resident_chunk> data; //only touched through std::atomic_load / atomic_store
+		std::atomic<std::uint64_t> last_used{ 0 };
+	};
+
+	//a ray that passes through a chunk's box, t_enter is where it goes in
+	struct batch_entry {
+		std::uint32_t chunk;
+		std::uint32_t ray;
+		double t_enter;
+	};
+
+	//1 / direction per axis, computed once per ray instead of once per box
+	struct ray_inverse {
+		double d[3];
+		ray_inverse(const ray& r) {
+			for (int a = 0; a < 3; a++) {
+				d[a] = 1.0 / r.direction()[a];
+			}
+		}
+	};
+
+	std::vector<chunk_entry> chunks;
+	std::unique_ptr<chunk_slot[]> slots; //one per chunk
+	std::vector<packed_node> top_nodes; //BVH over the chunks, leaves index into chunk_order
+	static const int max_stack_depth = 64; //traversal stack entries, chunk BVHs deeper than this are rejected
+	std::vector<std::uint32_t> chunk_order;
+	std::vector<shared_ptr<material>> materials;
+	std::uint64_t sphere_count = 0;
+
+	mutable std::atomic<std::uint64_t> use_clock{ 0 }; //stamps last_used, the oldest stamp is evicted first
+	mutable std::atomic<size_t> resident_bytes{ 0 };
+	mutable std::atomic<std::uint64_t> loads{ 0 };
+	mutable std::atomic<std::uint64_t> loaded_bytes{ 0 };
+	mutable std::atomic<std::uint64_t> evicted{ 0 };
+
+	mutable std::mutex cache_mutex; //guards memory_budget and resident_chunks, never held while copying from the file
+	size_t memory_budget;
+	mutable std::vector<std::uint32_t> resident_chunks;
+
+	mutable std::mutex load_mutex; //only for waiting on chunks another thread is loading
+	mutable std::condition_variable chunk_loaded;
+
+	const unsigned char* file_data = nullptr;
+	size_t file_bytes = 0;
+#ifdef _WIN32
+	HANDLE file_handle = INVALID_HANDLE_VALUE;
+	HANDLE mapping_handle = nullptr;
+#endif
+
+	bool fail(const std::string& path) {
+		std::cerr << "ERROR: '" << path << "' is not a valid scene file\n";
+		close();
+		return false;
+	}
+
+	//the chunk lies inside the file and its sphere and node counts fit in it, with at least one node
+	bool chunk_sizes_valid(const chunk_entry& entry) const {
+		if (entry.offset > file_bytes || entry.bytes > file_bytes - entry.offset || entry.bytes < 2 * sizeof(std::uint32_t)) {
+			return false;
+		}
+		std::uint32_t counts[2];
+		std::memcpy(counts, file_data + entry.offset, sizeof(counts));
+		return counts[1] > 0 && counts[0] > 0
+			&& std::uint64_t(counts[1]) * sizeof(packed_node) + std::uint64_t(counts[0]) * sizeof(packed_sphere) + sizeof(counts) <= entry.bytes;
+	}
+
+	/*the nodes have to form a real tree the way hit_chunk walks it: children come after their parent and inside the chunk,
+	no node has two parents (a DAG passes the index checks but a traversal can revisit shared subtrees exponentially often),
+	and it's shallow enough for the traversal stack. leaves only cover spheres that exist, and every sphere uses
+	a material that exists. then traversal visits each node at most once and never indexes out of bounds*/
+	bool chunk_contents_valid(const resident_chunk& chunk) const {
+		auto node_count = chunk.nodes.size();
+		auto sphere_total = chunk.spheres.size();
+		//parents come first, so one pass in index order sees every node's parent before the node itself
+		std::vector<char> has_parent(node_count, 0);
+		std::vector<int> depth(node_count, 0);
+		for (size_t k = 0; k < node_count; k++) {
+			const packed_node& node = chunk.nodes[k];
+			if (k > 0 && !has_parent[k]) {
+				//unreachable, the writer never leaves those
+				return false;
+			}
+			if (node.count > 0) {
+				if (node.offset > sphere_total || node.count > sphere_total - node.offset) {
+					return false;
+				}
+				continue;
+			}
+			if (k + 1 >= node_count || node.offset <= k + 1 || node.offset >= node_count) {
+				return false;
+			}
+			//popping a node at depth d leaves at most d siblings on the stack, then its two children go on top
+			if (depth[k] + 2 > max_stack_depth) {
+				return false;
+			}
+			for (std::uint32_t child : { std::uint32_t(k + 1), node.offset }) {
+				if (has_parent[child]) {
+					return false;
+				}
+				has_parent[child] = 1;
+				depth[child] = depth[k] + 1;
+			}
+		}
+		for (const auto& s : chunk.spheres) {
+			if (s.material >= materials.size()) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	/*returns the chunk, paging it in (and evicting others) if it isn't resident, or nullptr if it's broken.
+	the shared_ptr keeps a chunk alive for whoever is tracing it even if it gets evicted meanwhile*/
+	shared_ptr<const resident_chunk> acquire(std::uint32_t chunk) const {
+		chunk_slot& slot = slots[chunk];
+		while (true) {
+			auto data = std::atomic_load(&slot.data);
+			if (data) {
+				slot.last_used.store(++use_clock, std::memory_order_relaxed);
+				return data;
+			}
+			int expected = absent;
+			if (slot.state.compare_exchange_strong(expected, loading)) {
+				return load(chunk);
+			}
+			if (expected == broken) {
+				return nullptr;
+			}
+			if (expected == loading) {
+				std::unique_lock<std::mutex> lock(load_mutex);
+				chunk_loaded.wait(lock, [&]() { return slot.state != loading; });
+			}
+			else {
+				//resident but not published yet, or being evicted right now
+				std::this_thread::yield();
+			}
+		}
+	}
+
+	//copies a chunk in, checks it and publishes it. only the thread that moved the slot to loading calls this
+	shared_ptr<const resident_chunk> load(std::uint32_t chunk) const {
+		chunk_slot& slot = slots[chunk];
+		const chunk_entry& entry = chunks[chunk];
+		const unsigned char* src = file_data + entry.offset;
+		std::uint32_t counts[2];
+		std::memcpy(counts, src, sizeof(counts));
+		auto loaded = make_shared<resident_chunk>();
+		loaded->nodes.resize(counts[1]);
+		loaded->spheres.resize(counts[0]);
+		//open() checked that these counts fit in the chunk
+		std::memcpy(loaded->nodes.data(), src + sizeof(counts), counts[1] * sizeof(packed_node));
+		std::memcpy(loaded->spheres.data(), src + sizeof(counts) + counts[1] * sizeof(packed_node), counts[0] * sizeof(packed_sphere));
+		loaded->bytes = size_t(entry.bytes);
+		release_mapped_pages(entry);
+
+		bool valid = chunk_contents_valid(*loaded);
+		if (valid) {
+			slot.last_used.store(++use_clock, std::memory_order_relaxed);
+			std::atomic_store(&slot.data, shared_ptr<const resident_chunk>(loaded));
+			loads++;
+			loaded_bytes += entry.bytes;
+			std::lock_guard<std::mutex> lock(cache_mutex);
+			resident_chunks.push_back(chunk);
+			resident_bytes += loaded->bytes;
+			slot.state = resident_state;
+			evict_to_budget(chunk);
+		}
+		else {
+			std::cerr << "ERROR: scene file chunk " << chunk << " is corrupt, skipping it\n";
+			slot.state = broken;
+		}
+		{
+			std::lock_guard<std::mutex> lock(load_mutex);
+		}
+		chunk_loaded.notify_all();
+		return valid ? loaded : nullptr;
+	}
+
+	//drops least recently used chunks until we're within budget, never dropping keep. caller holds cache_mutex
+	void evict_to_budget(std::uint32_t keep) const {
+		while (resident_bytes > memory_budget && resident_chunks.size() > 1) {
+			size_t oldest = resident_chunks.size();
+			for (size_t k = 0; k < resident_chunks.size(); k++) {
+				auto c = resident_chunks[k];
+				if (c != keep && (oldest == resident_chunks.size() || slots[c].last_used < slots[resident_chunks[oldest]].last_used)) {
+					oldest = k;
+				}
+			}
+			if (oldest == resident_chunks.size()) {
+				return;
+			}
+			chunk_slot& slot = slots[resident_chunks[oldest]];
+			auto data = std::atomic_load(&slot.data);
+			resident_bytes -= data->bytes;
+			std::atomic_store(&slot.data, shared_ptr<const resident_chunk>());
+			slot.state = absent;
+			evicted++;
+			resident_chunks[oldest] = resident_chunks.back();
+			resident_chunks.pop_back();
+		}
+	}
+
+	bool hit_chunk(const resident_chunk& chunk, const ray& r, const ray_inverse& inv, interval ray_t, hit_record& rec) const {
+		bool hit_anything = false;
+		std::uint32_t stack[max_stack_depth];
+		int top = 0;
+		stack[top++] = 0;
+		while (top > 0) {
+			auto index = stack[--top];
+			const packed_node& node = chunk.nodes[index];
+			if (!hit_node(node, r, inv, ray_t)) {
+				continue;
+			}
+			if (node.count == 0) {
+				push_children(stack, top, index, node, r);
+				continue;
+			}
+			for (std::uint32_t k = node.offset; k < node.offset + node.count; k++) {
+				const packed_sphere& s = chunk.spheres[k];
+				point3 center(s.center[0], s.center[1], s.center[2]);
+				double root;
+				if (sphere::intersect(center, s.radius, r, ray_t, root)) {
+					hit_anything = true;
+					ray_t.max = root;
+					rec.t = root;
+					rec.p = r.at(root);
+					rec.set_face_normal(r, (rec.p - center) / double(s.radius));
+					rec.mat = materials[s.material];
+					rec.object = this;
+				}
+			}
+		}
+		return hit_anything;
+	}
+
+	//slab test against a packed node or a chunk_entry's box, t_enter is where the ray goes in
+	template <typename Box>
+	static bool hit_node(const Box& node, const ray& r, const ray_inverse& inv, interval ray_t) {
+		double t_enter;
+		return hit_node(node, r, inv, ray_t, t_enter);
+	}
+	template <typename Box>
+	static bool hit_node(const Box& node, const ray& r, const ray_inverse& inv, interval ray_t, double& t_enter) {
+		for (int a = 0; a < 3; a++) {
+			auto t0 = (node.bounds_min[a] - r.origin()[a]) * inv.d[a];
+			auto t1 = (node.bounds_max[a] - r.origin()[a]) * inv.d[a];
+			if (t0 > t1) std::swap(t0, t1);
+			if (t0 > ray_t.min) ray_t.min = t0;
+			if (t1 < ray_t.max) ray_t.max = t1;
+			if (ray_t.max < ray_t.min) {
+				return false;
+			}
+		}
+		t_enter = ray_t.min;
+		return true;
+	}
+
+	//pushes both children of the interior node at index, the one nearer the ray origin last so it gets popped (and shrinks ray_t) first
+	static void push_children(std::uint32_t* stack, int& top, std::uint32_t index, const packed_node& node, const ray& r) {
+		std::uint32_t left = index + 1;
+		std::uint32_t right = node.offset;
+		int axis = 0;
+		float extent = 0;
+		for (int a = 0; a < 3; a++) {
+			if (node.bounds_max[a] - node.bounds_min[a] > extent) {
+				extent = node.bounds_max[a] - node.bounds_min[a];
+				axis = a;
+			}
+		}
+		//children were split along (roughly) the longest axis, left holds the smaller coordinates
+		if (r.direction()[axis] < 0) {
+			std::swap(left, right);
+		}
+		if (top + 2 <= 64) {
+			stack[top++] = right;
+			stack[top++] = left;
+		}
+	}
+
+	bool map_file(const std::string& path) {
+#ifdef _WIN32
+		file_handle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (file_handle == INVALID_HANDLE_VALUE) {
+			std::cerr << "ERROR: could not open scene file '" << path << "'\n";
+			return false;
+		}
+		LARGE_INTEGER size;
+		GetFileSizeEx(file_handle, &size);
+		file_bytes = size_t(size.QuadPart);
+		mapping_handle = CreateFileMappingA(file_handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		void* p = mapping_handle ? MapViewOfFile(mapping_handle, FILE_MAP_READ, 0, 0, 0) : nullptr;
+		if (!p) {
+			std::cerr << "ERROR: could not map scene file '" << path << "'\n";
+			unmap_file();
+			return false;
+		}
+		file_data = static_cast<const unsigned char*>(p);
+#else
+		int fd = ::open(path.c_str(), O_RDONLY);
+		if (fd < 0) {
+			std::cerr << "ERROR: could not open scene file '" << path << "'\n";
+			return false;
+		}
+		struct stat info;
+		fstat(fd, &info);
+		file_bytes = size_t(info.st_size);
+		void* p = file_bytes ? mmap(nullptr, file_bytes, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+		::close(fd);
+		if (p == MAP_FAILED) {
+			std::cerr << "ERROR: could not map scene file '" << path << "'\n";
+			file_bytes = 0;
+			return false;
+		}
+		file_data = static_cast<const unsigned char*>(p);
+#endif
+		return true;
+	}
+
+	void unmap_file() {
+#ifdef _WIN32
+		if (file_data) UnmapViewOfFile(file_data);
+		if (mapping_handle) CloseHandle(mapping_handle);
+		if (file_handle != INVALID_HANDLE_VALUE) CloseHandle(file_handle);
+		mapping_handle = nullptr;
+		file_handle = INVALID_HANDLE_VALUE;
+#else
+		if (file_data) munmap(const_cast<unsigned char*>(file_data), file_bytes);
+#endif
+		file_data = nullptr;
+		file_bytes = 0;
+	}
+
+	//we keep our own copy of a loaded chunk, so the mapped pages behind it can go
+	void release_mapped_pages(const chunk_entry& entry) const {
+#ifndef _WIN32
+		//chunks start on 4 KiB boundaries in the file, but pages can be bigger (16 or 64 KiB on some arm systems).
+		//madvise wants a page aligned start, so only the whole pages inside the chunk are released
+		static const std::uint64_t page = std::uint64_t(sysconf(_SC_PAGESIZE));
+		std::uint64_t first = (entry.offset + page - 1) / page * page;
+		std::uint64_t last = (entry.offset + entry.bytes) / page * page;
+		if (last > first) {
+			madvise(const_cast<unsigned char*>(file_data) + first, size_t(last - first), MADV_DONTNEED);
+		}
+#endif
+	}
+};
+
+#endif
@@ -0,0 +1,593 @@
+#ifndef RENDER_SERVER_H
+#define RENDER_SERVER_H
+/*A long running render service for lots of small jobs next to big ones.
+
+Clients connect to a Unix domain socket and send one job per connection as a single line of key=value words:
+	scene=book width=160 spp=4 depth=8 priority=4 out=thumb.ppm
+The server answers with one line when the job is done:
+	ok queue_ms=... render_ms=... total_ms=... cached=1
+or "error <what went wrong>". Two more requests: "stats" answers with job and cache counts, "shutdown" stops the server.
+
+Scenes (and with them their acceleration structures, like an out of core scene's chunk BVHs and resident chunks)
+are loaded the first time a job asks for them and kept for later jobs. All jobs share one tile_scheduler,
+so a thumbnail with a higher priority gets its tiles ahead of a big frame without either one owning threads.*/
+#include "consts_n_utils.h"
+
+#include "camera.h"
+#include "color.h"
+#include "hittable_list.h"
+#include "light_list.h"
+#include "out_of_core_scene.h"
+#include "scenes.h"
+#include "tile_scheduler.h"
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+//one job: which scene, and whatever camera settings should differ from the scene's own
+class render_request {
+public:
+	std::string scene = "book"; //book, three_spheres, small_light, or a scene file ending in .bin
+	int width = 0; //0 keeps the scene's setting, for all of these
+	double aspect = 0;
+	int samples = 0;
+	int depth = 0;
+	double vfov = 0;
+	double defocus = -1;
+	double focus = 0;
+	bool has_from = false, has_at = false;
+	point3 from, at;
+	int priority = 1;
+	std::string out; //ppm to write the image to, nothing is written if empty
+
+	//limits on one job, so a bad request gets an error back instead of taking down the server.
+	//the pixel budgets are checked by within_budget once the scene's camera fills in what the request left out
+	static constexpr int max_width = 16384;
+	static constexpr double max_aspect = 16; //and 1 / 16 the other way
+	static constexpr int max_spp = 1 << 16;
+	static constexpr int max_bounces = 1024;
+	static constexpr double max_pixels = 64e6;
+	static constexpr double max_pixel_samples = 1e11;
+
+	//reads "key=value key=value ...", returns false and says why in error on a bad word
+	bool parse(const std::string& line, std::string& error) {
+		std::istringstream words(line);
+		std::string word;
+		while (words >> word) {
+			auto split = word.find('=');
+			if (split == std::string::npos) {
+				error = "expected key=value, got '" + word + "'";
+				return false;
+			}
+			std::string key = word.substr(0, split);
+			std::istringstream value(word.substr(split + 1));
+			bool ok = true;
+			if (key == "scene") ok = bool(value >> scene);
+			else if (key == "width") ok = bool(value >> width) && width > 0 && width <= max_width;
+			else if (key == "aspect") ok = bool(value >> aspect) && aspect >= 1 / max_aspect && aspect <= max_aspect;
+			else if (key == "spp") ok = bool(value >> samples) && samples > 0 && samples <= max_spp;
+			else if (key == "depth") ok = bool(value >> depth) && depth > 0 && depth <= max_bounces;
+			else if (key == "vfov") ok = bool(value >> vfov) && vfov > 0;
+			else if (key == "defocus") ok = bool(value >> defocus) && defocus >= 0;
+			else if (key == "focus") ok = bool(value >> focus) && focus > 0;
+			else if (key == "from") ok = has_from = read_point(value, from);
+			else if (key == "at") ok = has_at = read_point(value, at);
+			else if (key == "priority") ok = bool(value >> priority) && priority > 0;
+			else if (key == "out") ok = bool(value >> out);
+			else {
+				error = "unknown key '" + key + "'";
+				return false;
+			}
+			if (!ok) {
+				error = "bad value in '" + word + "'";
+				return false;
+			}
+		}
+		return true;
+	}
+
+	//overrides the scene's camera settings with the ones this request set
+	void apply(camera& cam) const {
+		if (width > 0) cam.image_width = width;
+		if (aspect > 0) cam.aspect_ratio = aspect;
+		if (samples > 0) cam.samples_per_pixel = samples;
+		if (depth > 0) cam.max_depth = depth;
+		if (vfov > 0) cam.vfov = vfov;
+		if (defocus >= 0) cam.defocus_angle = defocus;
+		if (focus > 0) cam.focus_dist = focus;
+		if (has_from) cam.lookfrom = from;
+		if (has_at) cam.lookat = at;
+	}
+
+	//false (and why in error) if the image cam would render is over the pixel or sample budget
+	static bool within_budget(const camera& cam, std::string& error) {
+		double pixels = double(cam.image_width) * std::fmax(1.0, cam.image_width / cam.aspect_ratio);
+		if (pixels > max_pixels) {
+			error = "image too large, at most " + std::to_string(int(max_pixels / 1e6)) + " megapixels";
+			return false;
+		}
+		if (pixels * cam.samples_per_pixel > max_pixel_samples) {
+			error = "too many samples, width * height * spp is at most " + std::to_string(int(max_pixel_samples / 1e9)) + " billion";
+			return false;
+		}
+		return true;
+	}
+
+private:
+	//x,y,z
+	static bool read_point(std::istream& in, point3& p) {
+		double x, y, z;
+		char c0, c1;
+		if (!(in >> x >> c0 >> y >> c1 >> z) || c0 != ',' || c1 != ',') {
+			return false;
+		}
+		p = point3(x, y, z);
+		return true;
+	}
+};
+
+//a loaded scene with the camera it comes with, shared read only by every job rendering it
+class cached_scene {
+public:
+	hittable_list world;
+	light_list lights;
+	camera cam;
+};
+
+//builds a scene by name, returns false and says why in error if there's no such scene
+inline bool load_scene(const std::string& name, cached_scene& scene, std::string& error) {
+	if (name == "book") {
+		book_scene(scene.world, scene.cam);
+	}
+	else if (name == "three_spheres") {
+		three_spheres_scene(scene.world, scene.cam);
+	}
+	else if (name == "small_light") {
+		small_light_scene(scene.world, scene.lights, scene.cam);
+	}
+	else if (name.size() > 4 && name.compare(name.size() - 4, 4, ".bin") == 0) {
+		auto file = make_shared<out_of_core_scene>();
+		if (!file->open(name)) {
+			error = "could not open scene file '" + name + "'";
+			return false;
+		}
+		scene.world.add(file);
+		//looking down at the middle of the scene from above one side
+		auto box = file->bounding_box();
+		auto size = std::fmax(box.x.size(), box.z.size());
+		scene.cam.aspect_ratio = 16.0 / 9.0;
+		scene.cam.vfov = 40;
+		scene.cam.lookat = box.centroid();
+		scene.cam.lookfrom = box.centroid() + vec3(0, 0.4 * size, 0.6 * size);
+	}
+	else {
+		error = "unknown scene '" + name + "'";
+		return false;
+	}
+	return true;
+}
+
+//scenes by name, each one loaded the first time it's asked for.
+//past capacity the least recently asked for loaded scene is dropped, jobs still rendering it keep their own reference
+class scene_cache {
+public:
+	size_t capacity = 8;
+
+	//returns nullptr (and why in error) if the scene can't be loaded. cached is set if it was already loaded
+	//the first job to ask for a scene loads it outside the lock, jobs asking for it meanwhile wait for that load
+	//instead of starting their own, and jobs for other scenes don't wait at all
+	shared_ptr<const cached_scene> get(const std::string& name, std::string& error, bool& cached) {
+		std::shared_future<load_result> loaded;
+		std::promise<load_result> loading;
+		std::uint64_t id = 0;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			auto it = scenes.find(name);
+			cached = (it != scenes.end());
+			if (cached) {
+				hits++;
+				loaded = it->second.loaded;
+				it->second.last_used = ++clock;
+			}
+			else {
+				misses++;
+				loaded = loading.get_future().share();
+				id = ++next_id;
+				scenes[name] = { loaded, ++clock, id };
+				evict_to_capacity(name);
+			}
+		}
+		if (!cached) {
+			load_result result;
+			auto scene = make_shared<cached_scene>();
+			if (load_scene(name, *scene, result.error)) {
+				result.scene = scene;
+			}
+			else {
+				//not kept, so a later job tries again. unless it was evicted and asked for again meanwhile
+				std::lock_guard<std::mutex> lock(mutex);
+				auto it = scenes.find(name);
+				if (it != scenes.end() && it->second.id == id) {
+					scenes.erase(it);
+				}
+			}
+			loading.set_value(result);
+		}
+		const load_result& result = loaded.get();
+		if (!result.scene) {
+			error = result.error;
+		}
+		return result.scene;
+	}
+
+	std::atomic<size_t> hits{ 0 };
+	std::atomic<size_t> misses{ 0 };
+	std::atomic<size_t> evictions{ 0 };
+
+private:
+	struct load_result {
+		shared_ptr<const cached_scene> scene; //nullptr if it failed
+		std::string error;
+	};
+	struct entry {
+		std::shared_future<load_result> loaded;
+		std::uint64_t last_used; //clock at the last get
+		std::uint64_t id; //tells a reload apart from the entry it replaced
+	};
+
+	std::mutex mutex; //guards everything below, not the loads
+	std::unordered_map<std::string, entry> scenes;
+	std::uint64_t clock = 0;
+	std::uint64_t next_id = 0;
+
+	//drops least recently used scenes other than keep until there are at most capacity.
+	//scenes still loading stay, their loaders are about to hand them out
+	void evict_to_capacity(const std::string& keep) {
+		while (scenes.size() > capacity) {
+			auto oldest = scenes.end();
+			for (auto it = scenes.begin(); it != scenes.end(); ++it) {
+				bool ready = it->second.loaded.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+				if (it->first != keep && ready && (oldest == scenes.end() || it->second.last_used < oldest->second.last_used)) {
+					oldest = it;
+				}
+			}
+			if (oldest == scenes.end()) {
+				return;
+			}
+			scenes.erase(oldest);
+			evictions++;
+		}
+	}
+};
+
+//how a job went, all times from when run_job was called
+class job_result {
+public:
+	bool ok = false;
+	std::string error;
+	bool scene_cached = false;
+	double queue_seconds = 0; //from submitting the tiles until the first one started
+	double render_seconds = 0; //first tile started to last tile done
+	double total_seconds = 0; //including loading the scene and writing the image
+};
+
+//renders one job in tiles on pool and writes its image if the request asks for it
+inline job_result run_job(const render_request& request, scene_cache& scenes, tile_scheduler& pool) {
+	auto start = std::chrono::steady_clock::now();
+	job_result result;
+	auto scene = scenes.get(request.scene, result.error, result.scene_cached);
+	if (!scene) {
+		return result;
+	}
+	camera cam = scene->cam;
+	request.apply(cam);
+	if (!render_request::within_budget(cam, result.error)) {
+		return result;
+	}
+	cam.prepare(scene->world);
+	int width = cam.image_width;
+	int height = cam.height();
+	std::vector<color> image(size_t(width) * height);
+
+	//square tiles, small enough that a thumbnail is still a few of them
+	const int tile_size = 32;
+	int tiles_x = (width + tile_size - 1) / tile_size;
+	int tiles_y = (height + tile_size - 1) / tile_size;
+	tile_task task;
+	task.priority = request.priority;
+	task.tile_count = tiles_x * tiles_y;
+	task.render = [&](int tile) {
+		int x0 = (tile % tiles_x) * tile_size;
+		int y0 = (tile / tiles_x) * tile_size;
+		cam.render_tile(scene->world, scene->lights, image, x0, y0, std::min(x0 + tile_size, width), std::min(y0 + tile_size, height));
+	};
+	pool.submit(task);
+	pool.wait(task);
+
+	if (!request.out.empty()) {
+		std::ofstream out(request.out);
+		if (!out) {
+			result.error = "could not write '" + request.out + "'";
+			return result;
+		}
+		write_ppm(out, image, width, height);
+	}
+	result.ok = true;
+	result.queue_seconds = std::chrono::duration<double>(task.started - task.submitted).count();
+	result.render_seconds = std::chrono::duration<double>(task.finished - task.started).count();
+	result.total_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	return result;
+}
+
+//the reply line the server sends for a job
+inline std::string job_reply(const job_result& result) {
+	if (!result.ok) {
+		return "error " + result.error;
+	}
+	std::ostringstream reply;
+	reply << "ok queue_ms=" << 1000 * result.queue_seconds << " render_ms=" << 1000 * result.render_seconds
+		<< " total_ms=" << 1000 * result.total_seconds << " cached=" << result.scene_cached;
+	return reply.str();
+}
+
+//runs one job in this process with its own scene and pool, the way every render used to be its own run of main
+inline int run_single_job(const std::string& line) {
+	render_request request;
+	std::string error;
+	if (!request.parse(line, error)) {
+		std::cerr << "ERROR: " << error << "\n";
+		return 1;
+	}
+	scene_cache scenes;
+	tile_scheduler pool;
+	auto result = run_job(request, scenes, pool);
+	std::cout << job_reply(result) << "\n";
+	return result.ok ? 0 : 1;
+}
+
+#ifndef _WIN32
+//longest line read_line takes, requests are a few dozen words
+const size_t max_line_length = 4096;
+
+//reads up to and not including the next newline, false if the connection closed first
+//or the line runs past max_line_length (line is then left that long)
+inline bool read_line(int fd, std::string& line) {
+	line.clear();
+	char c;
+	while (line.size() < max_line_length) {
+		auto n = ::recv(fd, &c, 1, 0);
+		if (n <= 0) {
+			return !line.empty();
+		}
+		if (c == '\n') {
+			return true;
+		}
+		line += c;
+	}
+	return false;
+}
+
+inline bool write_line(int fd, const std::string& line) {
+	std::string data = line + '\n';
+	int flags = 0;
+#ifdef MSG_NOSIGNAL
+	//a client that hung up shouldn't take the server down with a SIGPIPE
+	flags = MSG_NOSIGNAL;
+#endif
+	size_t sent = 0;
+	while (sent < data.size()) {
+		auto n = ::send(fd, data.data() + sent, data.size() - sent, flags);
+		if (n <= 0) {
+			return false;
+		}
+		sent += size_t(n);
+	}
+	return true;
+}
+
+inline bool socket_address(const std::string& path, sockaddr_un& address) {
+	std::memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	if (path.size() >= sizeof(address.sun_path)) {
+		std::cerr << "ERROR: socket path '" << path << "' is too long\n";
+		return false;
+	}
+	std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+	return true;
+}
+#endif
+
+class render_server {
+public:
+	//threads for the shared tile pool, 0 means one per hardware thread
+	render_server(int threads = 0) : pool(threads) {}
+	~render_server() { stop(); }
+
+	//creates the socket, replacing a stale one left at path
+	bool listen(const std::string& path) {
+#ifdef _WIN32
+		std::cerr << "ERROR: the render server needs Unix domain sockets, it isn't available in Windows builds\n";
+		return false;
+#else
+		sockaddr_un address;
+		if (!socket_address(path, address)) {
+			return false;
+		}
+		listen_fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+		::unlink(path.c_str());
+		if (listen_fd < 0 || ::bind(listen_fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || ::listen(listen_fd, 64) != 0) {
+			std::cerr << "ERROR: could not listen on '" << path << "'\n";
+			stop();
+			return false;
+		}
+		socket_path = path;
+		return true;
+#endif
+	}
+
+	//answers connections until a client sends "shutdown", each connection on its own thread
+	void serve() {
+#ifndef _WIN32
+		while (!stopping) {
+			int fd = ::accept(listen_fd, nullptr, nullptr);
+			if (fd < 0) {
+				int why = errno;
+				if (stopping || why == EINTR || why == ECONNABORTED) {
+					//interrupted, the client gave up before we got to it, or stop() closed the socket
+					continue;
+				}
+				if (why == EMFILE || why == ENFILE || why == ENOBUFS || why == ENOMEM) {
+					//out of descriptors or memory for now, give running jobs a moment to finish and free some
+					std::cerr << "ERROR: accept failed: " << std::strerror(why) << ", retrying\n";
+					std::this_thread::sleep_for(std::chrono::milliseconds(100));
+					continue;
+				}
+				std::cerr << "ERROR: accept failed: " << std::strerror(why) << ", stopping\n";
+				break;
+			}
+			reap_connections();
+			auto finished = std::make_shared<std::atomic<bool>>(false);
+			connections.emplace_back(std::thread([this, fd, finished]() {
+				handle(fd);
+				*finished = true;
+			}), finished);
+		}
+		for (auto& connection : connections) {
+			connection.first.join();
+		}
+		connections.clear();
+		stop();
+#endif
+	}
+
+	//closes the socket, serve() returns once the jobs it's running are answered
+	void stop() {
+#ifndef _WIN32
+		stopping = true;
+		int fd = listen_fd.exchange(-1);
+		if (fd >= 0) {
+			//wakes up the accept in serve()
+			::shutdown(fd, SHUT_RDWR);
+			::close(fd);
+			::unlink(socket_path.c_str());
+		}
+#endif
+	}
+
+	int threads() const { return pool.threads(); }
+
+private:
+	tile_scheduler pool;
+	scene_cache scenes;
+	std::atomic<int> listen_fd{ -1 };
+	std::string socket_path;
+	std::atomic<bool> stopping{ false };
+	std::atomic<size_t> jobs{ 0 }; //rendered
+	std::atomic<size_t> failed_jobs{ 0 }; //answered with an error
+	std::vector<std::pair<std::thread, shared_ptr<std::atomic<bool>>>> connections;
+
+#ifndef _WIN32
+	void handle(int fd) {
+		std::string line;
+		if (!read_line(fd, line)) {
+			if (line.size() >= max_line_length) {
+				write_line(fd, "error request longer than " + std::to_string(max_line_length) + " bytes");
+				failed_jobs++;
+			}
+		}
+		else {
+			if (line == "shutdown") {
+				write_line(fd, "ok");
+				stop();
+			}
+			else if (line == "stats") {
+				std::ostringstream reply;
+				reply << "ok jobs=" << jobs << " failed=" << failed_jobs << " threads=" << pool.threads()
+					<< " scene_hits=" << scenes.hits << " scene_misses=" << scenes.misses << " scene_evictions=" << scenes.evictions;
+				write_line(fd, reply.str());
+			}
+			else {
+				render_request request;
+				std::string error;
+				job_result result;
+				if (!request.parse(line, error)) {
+					result.error = error;
+				}
+				else {
+					//anything a job throws (running out of memory, say) is that job's error, not the server's
+					try {
+						result = run_job(request, scenes, pool);
+					}
+					catch (const std::exception& e) {
+						result = job_result();
+						result.error = std::string("job failed: ") + e.what();
+					}
+				}
+				write_line(fd, job_reply(result));
+				if (result.ok) {
+					jobs++;
+				}
+				else {
+					failed_jobs++;
+				}
+			}
+		}
+		::close(fd);
+	}
+
+	//joins connection threads that have answered, so a long running server doesn't pile them up
+	void reap_connections() {
+		for (size_t c = 0; c < connections.size();) {
+			if (*connections[c].second) {
+				connections[c].first.join();
+				connections[c] = std::move(connections.back());
+				connections.pop_back();
+			}
+			else {
+				c++;
+			}
+		}
+	}
+#endif
+};
+
+//sends one line to the server at socket_path and waits for its one line answer
+inline bool send_request(const std::string& socket_path, const std::string& line, std::string& reply) {
+#ifdef _WIN32
+	std::cerr << "ERROR: the render server needs Unix domain sockets, it isn't available in Windows builds\n";
+	return false;
+#else
+	sockaddr_un address;
+	if (!socket_address(socket_path, address)) {
+		return false;
+	}
+	int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0 || ::connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+		std::cerr << "ERROR: could not connect to '" << socket_path << "'\n";
+		if (fd >= 0) ::close(fd);
+		return false;
+	}
+	bool ok = write_line(fd, line) && read_line(fd, reply);
+	::close(fd);
+	return ok;
+#endif
+}
+
+#endif
@@ -0,0 +1,227 @@
+#ifndef SCENE_FILE_H
+#define SCENE_FILE_H
+/*Binary scene file for scenes too big to keep in memory as hittable objects.
+
+Spheres are grouped into spatially compact chunks, and every chunk carries its own BVH, so a chunk can be
+read in and traced on its own (that's what out_of_core_scene does). Everything is stored in native byte order.
+
+	header
+	material table            material_count * scene_material
+	chunk 0, chunk 1, ...     each starts on a 4096 byte boundary:
+	                          uint32 sphere_count, uint32 node_count, node_count * packed_node, sphere_count * packed_sphere
+	chunk table               chunk_count * chunk_entry, at header.chunk_table_offset
+
+The chunk table (bounds + where each chunk lives) is all a reader has to keep in memory up front.*/
+#include "consts_n_utils.h"
+#include "aabb.h"
+#include "material.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+//material description, turned into a real material when the scene is opened
+struct scene_material {
+	enum kind : std::uint32_t { lambertian_kind = 0, metal_kind = 1, dielectric_kind = 2, light_kind = 3 };
+	std::uint32_t type;
+	float albedo[3]; //albedo, or emitted color for lights
+	float param; //roughness for metal, refraction index for dielectric
+
+	shared_ptr<material> make() const {
+		color c(albedo[0], albedo[1], albedo[2]);
+		switch (type) {
+		case metal_kind: return make_shared<metal>(c, param);
+		case dielectric_kind: return make_shared<dielectric>(param);
+		case light_kind: return make_shared<diffuse_light>(c);
+		default: return make_shared<lambertian>(c);
+		}
+	}
+};
+
+//a sphere as it sits on disk, floats keep chunks small
+struct packed_sphere {
+	float center[3];
+	float radius;
+	std::uint32_t material; //index into the material table
+};
+
+//BVH node. count > 0 is a leaf holding items [offset, offset + count).
+//count == 0 is an interior node, its left child is the next node and its right child is node offset
+struct packed_node {
+	float bounds_min[3];
+	float bounds_max[3];
+	std::uint32_t offset;
+	std::uint32_t count;
+};
+
+struct chunk_entry {
+	float bounds_min[3];
+	float bounds_max[3];
+	std::uint64_t offset; //byte offset of the chunk in the file
+	std::uint64_t bytes;
+};
+
+struct scene_file_header {
+	char magic[8];
+	std::uint32_t version;
+	std::uint32_t material_count;
+	std::uint64_t chunk_count;
+	std::uint64_t chunk_table_offset;
+	std::uint64_t sphere_count;
+};
+
+inline const char* scene_file_magic() { return "RTSCENE"; }
+
+inline aabb packed_sphere_box(const packed_sphere& s) {
+	vec3 rvec(s.radius, s.radius, s.radius);
+	point3 c(s.center[0], s.center[1], s.center[2]);
+	return aabb(c - rvec, c + rvec);
+}
+
+/*Builds a BVH over boxes by splitting the longest axis of the centroids at the median.
+order comes back permuted so every leaf's items are contiguous: leaf items [offset, offset + count)
+are boxes[order[offset]] ... boxes[order[offset + count - 1]].*/
+class packed_bvh_builder {
+public:
+	packed_bvh_builder(const std::vector<aabb>& boxes, int leaf_size) : boxes(boxes), leaf_size(leaf_size) {}
+
+	void build(std::vector<std::uint32_t>& order, std::vector<packed_node>& nodes) {
+		order.resize(boxes.size());
+		for (size_t k = 0; k < order.size(); k++) {
+			order[k] = std::uint32_t(k);
+		}
+		nodes.clear();
+		if (!boxes.empty()) {
+			build_range(order, nodes, 0, order.size());
+		}
+	}
+
+private:
+	const std::vector<aabb>& boxes;
+	int leaf_size;
+
+	void build_range(std::vector<std::uint32_t>& order, std::vector<packed_node>& nodes, size_t begin, size_t end) {
+		aabb bounds, centroids;
+		for (size_t k = begin; k < end; k++) {
+			bounds = aabb(bounds, boxes[order[k]]);
+			point3 c = boxes[order[k]].centroid();
+			centroids = aabb(centroids, aabb(c, c));
+		}
+		size_t index = nodes.size();
+		nodes.push_back(make_node(bounds, std::uint32_t(begin), std::uint32_t(end - begin)));
+		if (end - begin <= size_t(leaf_size)) {
+			return;
+		}
+
+		int axis = centroids.longest_axis();
+		size_t mid = begin + (end - begin) / 2;
+		std::nth_element(order.begin() + begin, order.begin() + mid, order.begin() + end, [&](std::uint32_t a, std::uint32_t b) {
+			return boxes[a].centroid()[axis] < boxes[b].centroid()[axis];
+		});
+		nodes[index].count = 0;
+		build_range(order, nodes, begin, mid);
+		nodes[index].offset = std::uint32_t(nodes.size());
+		build_range(order, nodes, mid, end);
+	}
+
+	static packed_node make_node(const aabb& box, std::uint32_t offset, std::uint32_t count) {
+		packed_node node;
+		for (int a = 0; a < 3; a++) {
+			node.bounds_min[a] = float(box.axis_interval(a).min);
+			node.bounds_max[a] = float(box.axis_interval(a).max);
+		}
+		node.offset = offset;
+		node.count = count;
+		return node;
+	}
+};
+
+//writes a scene file one chunk at a time, so scenes bigger than memory can be generated without ever holding them whole
+class scene_file_writer {
+public:
+	//opens path for writing and stores the material table, prints an error and returns false on failure
+	bool open(const std::string& path, const std::vector<scene_material>& materials) {
+		out.open(path, std::ios::binary | std::ios::trunc);
+		if (!out) {
+			std::cerr << "ERROR: could not write scene file '" << path << "'\n";
+			return false;
+		}
+		std::memset(&header, 0, sizeof(header));
+		std::memcpy(header.magic, scene_file_magic(), sizeof(header.magic));
+		header.version = 1;
+		header.material_count = std::uint32_t(materials.size());
+		out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		out.write(reinterpret_cast<const char*>(materials.data()), std::streamsize(materials.size() * sizeof(scene_material)));
+		position = sizeof(header) + materials.size() * sizeof(scene_material);
+		chunks.clear();
+		return bool(out);
+	}
+
+	//builds the chunk's BVH (reordering spheres to match) and appends it
+	bool add_chunk(std::vector<packed_sphere> spheres) {
+		if (spheres.empty()) {
+			return true;
+		}
+		std::vector<aabb> boxes(spheres.size());
+		for (size_t k = 0; k < spheres.size(); k++) {
+			boxes[k] = packed_sphere_box(spheres[k]);
+		}
+		std::vector<std::uint32_t> order;
+		std::vector<packed_node> nodes;
+		packed_bvh_builder(boxes, 4).build(order, nodes);
+		std::vector<packed_sphere> sorted(spheres.size());
+		for (size_t k = 0; k < order.size(); k++) {
+			sorted[k] = spheres[order[k]];
+		}
+
+		pad_to(4096);
+		chunk_entry entry;
+		std::memcpy(entry.bounds_min, nodes[0].bounds_min, sizeof(entry.bounds_min));
+		std::memcpy(entry.bounds_max, nodes[0].bounds_max, sizeof(entry.bounds_max));
+		entry.offset = position;
+		std::uint32_t counts[2] = { std::uint32_t(sorted.size()), std::uint32_t(nodes.size()) };
+		write(counts, sizeof(counts));
+		write(nodes.data(), nodes.size() * sizeof(packed_node));
+		write(sorted.data(), sorted.size() * sizeof(packed_sphere));
+		entry.bytes = position - entry.offset;
+		chunks.push_back(entry);
+		header.sphere_count += sorted.size();
+		return bool(out);
+	}
+
+	//writes the chunk table and finishes the header
+	bool close() {
+		pad_to(64);
+		header.chunk_count = chunks.size();
+		header.chunk_table_offset = position;
+		write(chunks.data(), chunks.size() * sizeof(chunk_entry));
+		out.seekp(0);
+		out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		out.close();
+		return !out.fail();
+	}
+
+	std::uint64_t bytes_written() const { return position; }
+
+private:
+	std::ofstream out;
+	scene_file_header header;
+	std::vector<chunk_entry> chunks;
+	std::uint64_t position = 0;
+
+	void write(const void* data, size_t bytes) {
+		out.write(static_cast<const char*>(data), std::streamsize(bytes));
+		position += bytes;
+	}
+
+	void pad_to(std::uint64_t alignment) {
+		static const char zeros[4096] = {};
+		auto padding = (alignment - position % alignment) % alignment;
+		write(zeros, size_t(padding));
+	}
+};
+
+#endif
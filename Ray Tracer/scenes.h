@@ -0,0 +1,124 @@
+#ifndef SCENES_H
+#define SCENES_H
+//scenes built in code, used by the normal render, the benchmarks and the render server
+#include "consts_n_utils.h"
+
+#include "camera.h"
+#include "hittable_list.h"
+#include "light_list.h"
+#include "material.h"
+#include "sphere.h"
+
+//the final scene of the book: a field of small random spheres around three big ones, with a camera looking at them
+inline void book_scene(hittable_list& world, camera& cam) {
+	//grey colored ground
+	auto ground_material = make_shared<lambertian>(color(0.5, 0.5, 0.5));
+	//sphere representing the ground
+	world.add(make_shared<sphere>(point3(0, -1000, 0), 1000, ground_material));
+
+	//For loop to populate world with spheres
+	for (int a = -11; a < 11; a++) {
+		for (int b = -11; b < 11; b++) {
+			//generate a random double to pick which material to use
+			auto choose_mat = random_double();
+			//place the sphere within a certain radius of a and b iteration
+			point3 center(a + 0.9 * random_double(), 0.2, b + 0.9 * random_double());
+			if ((center - point3(4, 0.2, 0)).length() > 0.9) {
+				shared_ptr<material> sphere_material;
+				if (choose_mat < 0.8) {
+					//create diffuse material, approx 80% of spheres will be lambertian
+					//randomly generate sphere color
+					auto albedo = color::random() * color::random();
+					sphere_material = make_shared<lambertian>(albedo);
+					world.add(make_shared<sphere>(center, 0.2, sphere_material));
+				}
+				else if (choose_mat < 0.95) {
+					//create metal material, approx 15% of our spheres will be metal
+					//randomly generate our metal's color and roughness
+					auto albedo = color::random(0.5, 1);
+					auto roughness = random_double(0, 0.5);
+					sphere_material = make_shared<metal>(albedo, roughness);
+					world.add(make_shared<sphere>(center, 0.2, sphere_material));
+				}
+				else {
+					//finally make a glass material, approximately 5% of the spheres will be glass
+					sphere_material = make_shared<dielectric>(1.5);
+					world.add(make_shared<sphere>(center, 0.2, sphere_material));
+				}
+			}
+		}
+	}
+
+	//make 3 bigger spheres to show off each type of material
+	auto material1 = make_shared<dielectric>(1.5);
+	world.add(make_shared<sphere>(point3(0, 1, 0), 1.0, material1));
+
+	auto material2 = make_shared<lambertian>(color(0.4, 0.2, 0.1));
+	world.add(make_shared<sphere>(point3(-4, 1, 0), 1.0, material2));
+
+	auto material3 = make_shared<metal>(color(0.7, 0.6, 0.5), 0.0);
+	world.add(make_shared<sphere>(point3(4, 1, 0), 1.0, material3));
+
+	//camera
+	cam.aspect_ratio = 16.0 / 9.0;
+	//set camera position and angle
+	cam.vfov = 20;
+	cam.lookfrom = point3(13, 2, 3);
+	cam.lookat = point3(0, 0, 0);
+	cam.vup = vec3(0, 1, 0);
+
+	cam.defocus_angle = 0.6;
+	cam.focus_dist = 10.0;
+}
+
+//ground plus three spheres (two diffuse, one rough metal) and a camera looking at them, shared by the benchmark scenes
+inline void three_spheres_scene(hittable_list& world, camera& cam) {
+	world.add(make_shared<sphere>(point3(0, -1000, 0), 1000, make_shared<lambertian>(color(0.5, 0.5, 0.5))));
+	world.add(make_shared<sphere>(point3(-2.2, 1, 0), 1.0, make_shared<lambertian>(color(0.4, 0.2, 0.1))));
+	world.add(make_shared<sphere>(point3(0, 1, 0), 1.0, make_shared<lambertian>(color(0.2, 0.3, 0.6))));
+	world.add(make_shared<sphere>(point3(2.2, 1, 0), 1.0, make_shared<metal>(color(0.7, 0.6, 0.5), 0.3)));
+
+	cam.aspect_ratio = 16.0 / 9.0;
+	cam.image_width = 160;
+	cam.max_depth = 8;
+	cam.vfov = 30;
+	cam.lookfrom = point3(0, 3, 12);
+	cam.lookat = point3(0, 1, 0);
+}
+
+//the three spheres in the dark lit by one small, bright light
+//the kind of scene that takes forever when paths have to find the light by chance
+inline void small_light_scene(hittable_list& world, light_list& lights, camera& cam) {
+	three_spheres_scene(world, cam);
+
+	auto light_radius = 0.1;
+	auto light_emit = color(120, 120, 120);
+	auto light = make_shared<sphere>(point3(0, 3.5, 1.5), light_radius, make_shared<diffuse_light>(light_emit));
+	world.add(light);
+	lights.add(light, light_emit.y() * 4 * pi * light_radius * light_radius);
+
+	cam.sky_gradient = false;
+	cam.background = color(0, 0, 0);
+}
+
+//the three spheres in the dark under a grid of count small lights with random colors and strengths
+//light sampling has to pick the lights that matter, not just find one
+inline void many_lights_scene(hittable_list& world, light_list& lights, camera& cam, int count) {
+	three_spheres_scene(world, cam);
+
+	auto light_radius = 0.05;
+	int side = int(std::ceil(std::sqrt(double(count))));
+	for (int k = 0; k < count; k++) {
+		point3 center(-4 + 8.0 * (k % side + 0.5) / side, 3 + random_double(), -3 + 6.0 * (k / side + 0.5) / side);
+		auto light_emit = color::random(0.2, 1) * random_double(20, 400);
+		auto light = make_shared<sphere>(center, light_radius, make_shared<diffuse_light>(light_emit));
+		world.add(light);
+		auto luminance = (light_emit.x() + light_emit.y() + light_emit.z()) / 3;
+		lights.add(light, luminance * 4 * pi * light_radius * light_radius);
+	}
+
+	cam.sky_gradient = false;
+	cam.background = color(0, 0, 0);
+}
+
+#endif
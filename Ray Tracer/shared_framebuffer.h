@@ -0,0 +1,256 @@
+#ifndef SHARED_FRAMEBUFFER_H
+#define SHARED_FRAMEBUFFER_H
+/*Double buffered framebuffer in named shared memory, so another process can look at a render while it's running.
+POSIX shared memory (shm_open) on linux/mac, a named file mapping on windows.
+
+Layout: a small header followed by two float rgb images (linear, already divided by the sample count).
+The renderer only ever writes the back buffer, then publishes it by flipping `front` and bumping `sequence`.
+Publishing is two atomic stores, so the render threads never wait on a reader.
+Readers copy the front buffer and check sequence didn't move while they copied (a seqlock), retrying if it did:
+the writer can only start overwriting the buffer a reader is copying after its next publish.*/
+#include "consts_n_utils.h"
+
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+class shared_framebuffer {
+public:
+	shared_framebuffer() {}
+	~shared_framebuffer() { close(); }
+	shared_framebuffer(const shared_framebuffer&) = delete;
+	shared_framebuffer& operator=(const shared_framebuffer&) = delete;
+
+	//creates the named framebuffer for writing, returns false and prints an error on failure.
+	//a framebuffer left under the same name is unlinked rather than reused: whoever still has it mapped
+	//keeps the old memory instead of having it truncated under them
+	bool create(const std::string& name, int width, int height) {
+		close();
+		size_t bytes = buffers_offset() + 2 * size_t(width) * height * 3 * sizeof(float);
+		if (!map(name, bytes, true)) {
+			return false;
+		}
+		owner = true;
+		std::memcpy(hdr->magic, magic_string(), sizeof(hdr->magic));
+		hdr->width = std::uint32_t(width);
+		hdr->height = std::uint32_t(height);
+		hdr->samples[0] = hdr->samples[1] = 0;
+		hdr->front.store(0, std::memory_order_relaxed);
+		hdr->sequence.store(0, std::memory_order_release);
+		return true;
+	}
+
+	//opens a framebuffer some other process created, read only
+	bool open(const std::string& name) {
+		close();
+		if (!map(name, 0, false)) {
+			return false;
+		}
+		if (mapped_bytes < buffers_offset() || std::memcmp(hdr->magic, magic_string(), sizeof(hdr->magic)) != 0
+			|| mapped_bytes < buffers_offset() + 2 * size_t(hdr->width) * hdr->height * 3 * sizeof(float)) {
+			std::cerr << "ERROR: '" << name << "' is not a preview framebuffer\n";
+			close();
+			return false;
+		}
+		return true;
+	}
+
+	void close() {
+		if (!base) {
+			return;
+		}
+#ifdef _WIN32
+		UnmapViewOfFile(base);
+		CloseHandle(mapping);
+		mapping = nullptr;
+#else
+		munmap(base, mapped_bytes);
+		if (owner) {
+			//only if the name is still ours, a newer renderer may have made its own under it since
+			int fd = shm_open(shm_name.c_str(), O_RDONLY, 0);
+			struct stat info;
+			if (fd >= 0 && fstat(fd, &info) == 0 && info.st_ino == shm_inode) {
+				shm_unlink(shm_name.c_str());
+			}
+			if (fd >= 0) {
+				::close(fd);
+			}
+		}
+#endif
+		base = nullptr;
+		hdr = nullptr;
+		mapped_bytes = 0;
+		owner = false;
+	}
+
+	bool is_open() const { return base != nullptr; }
+	int width() const { return hdr ? int(hdr->width) : 0; }
+	int height() const { return hdr ? int(hdr->height) : 0; }
+
+	//writer side: the buffer readers aren't looking at, width * height * 3 floats
+	float* back_buffer() {
+		return buffer(1 - hdr->front.load(std::memory_order_relaxed));
+	}
+
+	//writer side: makes the back buffer (holding samples spp) the one readers see
+	void publish(int samples) {
+		auto back = 1 - hdr->front.load(std::memory_order_relaxed);
+		hdr->samples[back] = std::uint32_t(samples);
+		hdr->front.store(back, std::memory_order_release);
+		hdr->sequence.fetch_add(1, std::memory_order_acq_rel);
+	}
+
+	//reader side: copies the latest published image, returns false if nothing has been published yet
+	bool read(std::vector<color>& pixels, int& samples) const {
+		size_t pixel_count = size_t(width()) * height();
+		std::vector<float> copy(pixel_count * 3);
+		while (true) {
+			auto before = hdr->sequence.load(std::memory_order_acquire);
+			if (before == 0) {
+				return false;
+			}
+			auto front = hdr->front.load(std::memory_order_acquire);
+			samples = int(hdr->samples[front]);
+			std::memcpy(copy.data(), buffer(front), copy.size() * sizeof(float));
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if (hdr->sequence.load(std::memory_order_relaxed) == before) {
+				break;
+			}
+			//the renderer published while we were copying, so it may be writing into our buffer now, try again
+		}
+		pixels.resize(pixel_count);
+		for (size_t k = 0; k < pixel_count; k++) {
+			pixels[k] = color(copy[k * 3], copy[k * 3 + 1], copy[k * 3 + 2]);
+		}
+		return true;
+	}
+
+private:
+	struct header {
+		char magic[8];
+		std::uint32_t width, height;
+		std::uint32_t samples[2]; //spp accumulated in each buffer
+		std::atomic<std::uint32_t> front; //index of the buffer readers should copy
+		std::atomic<std::uint32_t> sequence; //bumped on every publish, 0 means nothing published yet
+	};
+	static const char* magic_string() { return "RTPREV1"; }
+
+	void* base = nullptr;
+	header* hdr = nullptr;
+	size_t mapped_bytes = 0;
+	bool owner = false;
+#ifdef _WIN32
+	HANDLE mapping = nullptr;
+#else
+	std::string shm_name;
+	ino_t shm_inode = 0; //of the segment we created, to tell it apart from a later one with the same name
+#endif
+
+	//images start on a cache line boundary after the header
+	static size_t buffers_offset() {
+		return (sizeof(header) + 63) / 64 * 64;
+	}
+
+	float* buffer(std::uint32_t index) const {
+		size_t floats = size_t(hdr->width) * hdr->height * 3;
+		return reinterpret_cast<float*>(static_cast<char*>(base) + buffers_offset()) + index * floats;
+	}
+
+	//maps the named region, bytes is only used when creating it
+	bool map(const std::string& name, size_t bytes, bool create) {
+#ifdef _WIN32
+		std::string mapping_name = "Local\\" + name;
+		if (create) {
+			mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE,
+				DWORD(std::uint64_t(bytes) >> 32), DWORD(bytes & 0xffffffffu), mapping_name.c_str());
+		}
+		else {
+			mapping = OpenFileMappingA(FILE_MAP_READ, FALSE, mapping_name.c_str());
+		}
+		if (!mapping) {
+			std::cerr << "ERROR: could not " << (create ? "create" : "open") << " shared framebuffer '" << name << "'\n";
+			return false;
+		}
+		if (create && GetLastError() == ERROR_ALREADY_EXISTS) {
+			//someone still has a framebuffer by this name open, and it may be a different size
+			std::cerr << "ERROR: shared framebuffer '" << name << "' is already in use\n";
+			CloseHandle(mapping);
+			mapping = nullptr;
+			return false;
+		}
+		base = MapViewOfFile(mapping, create ? FILE_MAP_ALL_ACCESS : FILE_MAP_READ, 0, 0, bytes);
+		if (!base) {
+			std::cerr << "ERROR: could not map shared framebuffer '" << name << "'\n";
+			CloseHandle(mapping);
+			mapping = nullptr;
+			return false;
+		}
+		MEMORY_BASIC_INFORMATION info;
+		VirtualQuery(base, &info, sizeof(info));
+		mapped_bytes = create ? bytes : size_t(info.RegionSize);
+#else
+		shm_name = "/" + name;
+		if (create) {
+			//truncating a segment someone has mapped gets them a SIGBUS, so take the name away from it instead
+			//and make a fresh one. O_EXCL fails if another renderer got there in between
+			shm_unlink(shm_name.c_str());
+		}
+		int fd = create ? shm_open(shm_name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644) : shm_open(shm_name.c_str(), O_RDONLY, 0);
+		if (fd < 0) {
+			std::cerr << "ERROR: could not " << (create ? "create" : "open") << " shared framebuffer '" << name << "'\n";
+			return false;
+		}
+		if (create && ftruncate(fd, off_t(bytes)) != 0) {
+			std::cerr << "ERROR: could not size shared framebuffer '" << name << "'\n";
+			::close(fd);
+			shm_unlink(shm_name.c_str());
+			return false;
+		}
+		struct stat info;
+		fstat(fd, &info);
+		if (create) {
+			shm_inode = info.st_ino;
+		}
+		else {
+			bytes = size_t(info.st_size);
+		}
+		void* p = mmap(nullptr, bytes, create ? (PROT_READ | PROT_WRITE) : PROT_READ, MAP_SHARED, fd, 0);
+		::close(fd);
+		if (p == MAP_FAILED) {
+			std::cerr << "ERROR: could not map shared framebuffer '" << name << "'\n";
+			if (create) {
+				shm_unlink(shm_name.c_str());
+			}
+			return false;
+		}
+		base = p;
+		mapped_bytes = bytes;
+#endif
+		hdr = static_cast<header*>(base);
+		if (create) {
+			//the atomics live in raw shared memory, construct them in place
+			new (&hdr->front) std::atomic<std::uint32_t>(0);
+			new (&hdr->sequence) std::atomic<std::uint32_t>(0);
+		}
+		return true;
+	}
+};
+
+#endif
@@ -2,6 +2,8 @@
 #define SPHERE_H
 
 #include "hittable.h"
+#include "material.h"
+#include "onb.h"
 
 class sphere : public hittable {
 public:
@@ -10,6 +12,28 @@ public:
 	};
 
 	bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
+		double root;
+		if (!intersect(center, radius, r, ray_t, root)) {
+			return false;
+		}
+		rec.t = root;
+		rec.p = r.at(rec.t);
+		vec3 outward_normal = (rec.p - center) / radius;
+		//is our ray coming from inside or outside? and set normal accordingly
+		rec.set_face_normal(r, outward_normal);
+		//Don't forget to record the material! (I did the first time :( )
+		rec.mat = mat;
+		rec.object = this;
+		return true;
+	}
+
+	unsigned material_kinds() const override {
+		return mat->kind();
+	}
+
+	//ray/sphere intersection on its own, so code that stores spheres without a sphere object (out of core scenes) can share it
+	//root is the nearest t inside ray_t
+	static bool intersect(const point3& center, double radius, const ray& r, interval ray_t, double& root) {
 		//oc = vector from ray origina to sphere center
 		vec3 oc = center - r.origin();
 		//coefficients for quadratic formula
@@ -33,26 +57,58 @@ public:
 		//find the nearest root which lies in the acceptable range
 		auto sqrtd = std::sqrt(discriminant);
 		//+ or - part of the quadratic form
-		auto root = (h - sqrtd) / a;
+		root = (h - sqrtd) / a;
 		if (!ray_t.surrounds(root)) {
 			root = (h + sqrtd) / a;
 			if (!ray_t.surrounds(root)) {
 				return false;
 			}
 		}
-		rec.t = root;
-		rec.p = r.at(rec.t);
-		vec3 outward_normal = (rec.p - center) / radius;
-		//is our ray coming from inside or outside? and set normal accordingly
-		rec.set_face_normal(r, outward_normal);
-		//Don't forget to record the material! (I did the first time :( )
-		rec.mat = mat;
 		return true;
 	}
+
+	//a sphere seen from outside covers a cone of directions, so we sample uniformly inside that cone
+	double pdf_value(const point3& origin, const vec3& direction) const override {
+		hit_record rec;
+		if (!this->hit(ray(origin, direction), interval(0.001, infinity), rec)) {
+			return 0;
+		}
+		auto distance_squared = (center - origin).length_squared();
+		if (distance_squared <= radius * radius) {
+			//origin is inside the sphere, there's no cone to sample
+			return 0;
+		}
+		auto cos_theta_max = std::sqrt(1 - radius * radius / distance_squared);
+		auto solid_angle = 2 * pi * (1 - cos_theta_max);
+		return 1 / solid_angle;
+	}
+
+	vec3 random(const point3& origin) const override {
+		vec3 direction = center - origin;
+		auto distance_squared = direction.length_squared();
+		if (distance_squared <= radius * radius) {
+			return direction;
+		}
+		onb uvw(direction);
+		return uvw.transform(random_to_sphere(radius, distance_squared));
+	}
 private:
 	point3 center;
 	double radius;
 	shared_ptr<material> mat;
+
+	//random direction (in a frame where z points at the sphere center) inside the cone the sphere subtends
+	static vec3 random_to_sphere(double radius, double distance_squared) {
+		auto r1 = random_double();
+		auto r2 = random_double();
+		auto z = 1 + r2 * (std::sqrt(1 - radius * radius / distance_squared) - 1);
+
+		auto phi = 2 * pi * r1;
+		auto x = std::cos(phi) * std::sqrt(1 - z * z);
+		auto y = std::sin(phi) * std::sqrt(1 - z * z);
+
+		return vec3(x, y, z);
+	}
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,131 @@
+#ifndef TILE_SCHEDULER_H
+#define TILE_SCHEDULER_H
+/*One pool of render threads shared by every job, handing out tiles one at a time.
+
+Jobs don't get threads of their own. Whenever a thread is free it takes the next tile of whichever job is furthest
+behind its fair share (stride scheduling): every tile handed out moves a job's pass forward by 1 / priority,
+and the job with the smallest pass goes next. A priority 4 thumbnail gets four tiles for every one of a
+priority 1 frame, but the frame never stops moving. A job that shows up late starts at the pass of the
+last tile handed out, so it can't make up for the time it wasn't around by hogging the pool.*/
+#include "consts_n_utils.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//a job split into tiles, render(tile) is called once for each tile in [0, tile_count) from the pool's threads
+class tile_task {
+public:
+	std::function<void(int)> render;
+	int tile_count = 0;
+	int priority = 1; //share of the pool relative to other jobs, at least 1
+
+	//filled in by the scheduler
+	std::chrono::steady_clock::time_point submitted;
+	std::chrono::steady_clock::time_point started; //first tile handed out
+	std::chrono::steady_clock::time_point finished; //last tile done
+
+	bool done() const { return tiles_done == tile_count; }
+
+private:
+	friend class tile_scheduler;
+	int next_tile = 0;
+	int tiles_done = 0;
+	double pass = 0;
+};
+
+class tile_scheduler {
+public:
+	//threads = 0 means one per hardware thread
+	tile_scheduler(int threads = 0) {
+		if (threads <= 0) {
+			threads = std::max(1, int(std::thread::hardware_concurrency()));
+		}
+		for (int t = 0; t < threads; t++) {
+			workers.emplace_back([this]() { work(); });
+		}
+	}
+	~tile_scheduler() {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		work_ready.notify_all();
+		for (auto& worker : workers) {
+			worker.join();
+		}
+	}
+	tile_scheduler(const tile_scheduler&) = delete;
+	tile_scheduler& operator=(const tile_scheduler&) = delete;
+
+	int threads() const { return int(workers.size()); }
+
+	//queues the task's tiles, the task has to stay alive until wait returns
+	void submit(tile_task& task) {
+		std::lock_guard<std::mutex> lock(mutex);
+		task.submitted = std::chrono::steady_clock::now();
+		task.priority = std::max(1, task.priority);
+		task.pass = virtual_time;
+		if (task.tile_count <= 0) {
+			task.started = task.finished = task.submitted;
+			return;
+		}
+		active.push_back(&task);
+		work_ready.notify_all();
+	}
+
+	//blocks until every tile of task is done
+	void wait(tile_task& task) {
+		std::unique_lock<std::mutex> lock(mutex);
+		task_done.wait(lock, [&]() { return task.done(); });
+	}
+
+private:
+	std::vector<std::thread> workers;
+	std::mutex mutex; //guards everything below and the scheduling fields of the tasks
+	std::condition_variable work_ready;
+	std::condition_variable task_done;
+	std::vector<tile_task*> active; //tasks with tiles left to hand out
+	double virtual_time = 0; //pass of the last tile handed out
+	bool stopping = false;
+
+	void work() {
+		std::unique_lock<std::mutex> lock(mutex);
+		while (true) {
+			work_ready.wait(lock, [&]() { return stopping || !active.empty(); });
+			if (stopping) {
+				return;
+			}
+			//the task furthest behind its share, ties go to the one submitted first
+			auto next = std::min_element(active.begin(), active.end(), [](const tile_task* a, const tile_task* b) {
+				return a->pass < b->pass;
+			});
+			tile_task& task = **next;
+			int tile = task.next_tile++;
+			if (tile == 0) {
+				task.started = std::chrono::steady_clock::now();
+			}
+			virtual_time = task.pass;
+			task.pass += 1.0 / task.priority;
+			if (task.next_tile == task.tile_count) {
+				active.erase(next);
+			}
+
+			lock.unlock();
+			task.render(tile);
+			lock.lock();
+
+			task.tiles_done++;
+			if (task.done()) {
+				task.finished = std::chrono::steady_clock::now();
+				task_done.notify_all();
+			}
+		}
+	}
+};
+
+#endif
@@ -132,14 +132,24 @@ inline vec3 random_in_unit_disk() {
 
 //return a unit vector of random elements
 inline vec3 random_unit_vector() {
-	while (true) {
-		auto p = vec3::random(-1, 1); // pick a point in the cube [-1, 1]^3
-		auto lensq = p.length_squared(); // compute squared length of that point vector
-		if (1e-160 < lensq && lensq <= 1) { //if the point lies in the unit sphere, but if the length is too small we will get an inf vector when we normalize.
-			return p / sqrt(lensq); //normalize p to make it a unit vector, otherwise we'd be sampling in the sphere instead of the surface.
-		}
-		//for more info look up lambertuan scattering
-	}
+	//pick a height uniformly in [-1, 1] and an angle around the axis, by archimedes' hat-box theorem
+	//that's uniform on the sphere, and unlike picking points in a cube it never has to retry
+	auto z = 1 - 2 * random_double();
+	auto phi = 2 * pi * random_double();
+	auto r = std::sqrt(std::fmax(0.0, 1 - z * z));
+	return vec3(r * std::cos(phi), r * std::sin(phi), z);
+}
+
+//random direction around +z with pdf cos(theta) / pi (malley's method: uniform on the disk, projected up)
+inline vec3 random_cosine_direction() {
+	auto r1 = random_double();
+	auto r2 = random_double();
+
+	auto phi = 2 * pi * r1;
+	auto x = std::cos(phi) * std::sqrt(r2);
+	auto y = std::sin(phi) * std::sqrt(r2);
+	auto z = std::sqrt(1 - r2);
+	return vec3(x, y, z);
 }
 
 inline vec3 random_on_hemisphere(const vec3& normal) {
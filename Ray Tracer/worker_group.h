@@ -0,0 +1,84 @@
+#ifndef WORKER_GROUP_H
+#define WORKER_GROUP_H
+//a fixed set of threads that runs the same task on all of them, again and again.
+//for work split into rounds (denoiser passes, progressive passes) where starting and joining new threads every round costs
+//more than the round itself. the calling thread does its share as worker 0
+#include <algorithm>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class worker_group {
+public:
+	//threads counts the calling thread too, 0 means one per hardware thread
+	worker_group(int threads = 0) {
+		if (threads <= 0) {
+			threads = std::max(1, int(std::thread::hardware_concurrency()));
+		}
+		for (int t = 1; t < threads; t++) {
+			workers.emplace_back([this, t]() { work(t); });
+		}
+	}
+	~worker_group() {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		round_start.notify_all();
+		for (auto& worker : workers) {
+			worker.join();
+		}
+	}
+	worker_group(const worker_group&) = delete;
+	worker_group& operator=(const worker_group&) = delete;
+
+	int size() const { return int(workers.size()) + 1; }
+
+	//calls task(worker) for every worker in [0, size()) at once and returns when they're all done
+	void run(const std::function<void(int)>& task) {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			current = &task;
+			busy = int(workers.size());
+			round++;
+		}
+		round_start.notify_all();
+		task(0);
+		std::unique_lock<std::mutex> lock(mutex);
+		round_done.wait(lock, [&]() { return busy == 0; });
+		current = nullptr;
+	}
+
+private:
+	std::vector<std::thread> workers;
+	std::mutex mutex;
+	std::condition_variable round_start;
+	std::condition_variable round_done;
+	const std::function<void(int)>* current = nullptr;
+	unsigned long long round = 0;
+	int busy = 0;
+	bool stopping = false;
+
+	void work(int index) {
+		unsigned long long seen = 0;
+		std::unique_lock<std::mutex> lock(mutex);
+		while (true) {
+			round_start.wait(lock, [&]() { return stopping || round != seen; });
+			if (stopping) {
+				return;
+			}
+			seen = round;
+			auto task = current;
+			lock.unlock();
+			(*task)(index);
+			lock.lock();
+			if (--busy == 0) {
+				round_done.notify_one();
+			}
+		}
+	}
+};
+
+#endif